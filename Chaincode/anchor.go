@@ -0,0 +1,136 @@
+package main
+
+import (
+	"bytes"
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
+)
+
+// Anchoring mode keeps raw readings off-chain. The gateway stores them in a
+// content-addressed store, builds a Merkle tree per batch window and commits
+// only the root:
+//
+//	anchor~batchId -> Anchor
+//
+// Tree shape (must match Gateway/anchor.js):
+//
+//	leaf = sha256(0x00 || reading bytes)
+//	node = sha256(0x01 || left || right)
+//
+// an odd node at the end of a level is carried up unchanged.
+//
+// From and To are the caller's word for the window and prove nothing about
+// which readings it holds, so nothing else trusts them: an anchor vouches
+// only for readings that come with a proof against its root.
+
+type Anchor struct {
+	BatchID string `json:"batch_id"`
+	Root    string `json:"root"` // hex
+	From    uint64 `json:"from"`
+	To      uint64 `json:"to"`
+	Count   uint64 `json:"count"`
+	TxTs    uint64 `json:"tx_ts"`
+}
+
+// ProofStep is one sibling on the path from a leaf to the root.
+type ProofStep struct {
+	Hash string `json:"hash"` // hex
+	Left bool   `json:"left"` // sibling sits to the left
+}
+
+// AnchorBatch commits the Merkle root of one off-chain batch. An anchor
+// can never be replaced, otherwise it would prove nothing.
+func (s *SmartContract) AnchorBatch(ctx contractapi.TransactionContextInterface,
+	batchId string, root string, from uint64, to uint64, count uint64) error {
+
+	if r, err := hex.DecodeString(root); err != nil || len(r) != sha256.Size {
+		return fmt.Errorf("root must be a hex sha256")
+	}
+
+	stub := ctx.GetStub()
+	key, err := stub.CreateCompositeKey("anchor", []string{batchId})
+	if err != nil {
+		return err
+	}
+	if v, err := stub.GetState(key); err != nil {
+		return err
+	} else if v != nil {
+		return fmt.Errorf("batch %s already anchored", batchId)
+	}
+
+	now, err := txTimeMs(stub)
+	if err != nil {
+		return err
+	}
+	b, _ := json.Marshal(&Anchor{
+		BatchID: batchId, Root: root, From: from, To: to, Count: count, TxTs: now,
+	})
+	return stub.PutState(key, b)
+}
+
+func (s *SmartContract) GetAnchor(ctx contractapi.TransactionContextInterface,
+	batchId string) (*Anchor, error) {
+
+	key, _ := ctx.GetStub().CreateCompositeKey("anchor", []string{batchId})
+	v, err := ctx.GetStub().GetState(key)
+	if err != nil {
+		return nil, err
+	}
+	if v == nil {
+		return nil, fmt.Errorf("batch %s not anchored", batchId)
+	}
+	var a Anchor
+	if err := json.Unmarshal(v, &a); err != nil {
+		return nil, err
+	}
+	return &a, nil
+}
+
+// VerifyReading checks that reading (the exact bytes the gateway stored)
+// plus its Merkle proof hash up to the root anchored for batchId.
+func (s *SmartContract) VerifyReading(ctx contractapi.TransactionContextInterface,
+	batchId string, reading string, proofJson string) (bool, error) {
+
+	a, err := s.GetAnchor(ctx, batchId)
+	if err != nil {
+		return false, err
+	}
+	root, _ := hex.DecodeString(a.Root)
+
+	var proof []ProofStep
+	if err := json.Unmarshal([]byte(proofJson), &proof); err != nil {
+		return false, fmt.Errorf("bad proof: %v", err)
+	}
+
+	h := merkleLeaf([]byte(reading))
+	for _, step := range proof {
+		sib, err := hex.DecodeString(step.Hash)
+		if err != nil || len(sib) != sha256.Size {
+			return false, fmt.Errorf("bad proof hash %q", step.Hash)
+		}
+		if step.Left {
+			h = merkleNode(sib, h)
+		} else {
+			h = merkleNode(h, sib)
+		}
+	}
+	return bytes.Equal(h, root), nil
+}
+
+func merkleLeaf(data []byte) []byte {
+	d := sha256.New()
+	d.Write([]byte{0x00})
+	d.Write(data)
+	return d.Sum(nil)
+}
+
+func merkleNode(left, right []byte) []byte {
+	d := sha256.New()
+	d.Write([]byte{0x01})
+	d.Write(left)
+	d.Write(right)
+	return d.Sum(nil)
+}
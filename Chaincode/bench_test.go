@@ -0,0 +1,265 @@
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"strings"
+	"testing"
+	"time"
+)
+
+// Contract benchmarks against the in-memory stub in mockstub_test.go:
+//
+//	go test -run '^$' -bench . -benchmem
+//
+// The 1M-reading ledger takes a few seconds and about a gigabyte to build;
+// -short leaves it out.
+
+var historySizes = []int{1000, 100000, 1000000}
+
+var seeded = map[int]*memLedger{}
+
+// seededLedger returns a ledger holding n readings of AB12, built once per
+// size and shared by the read benchmarks.
+func seededLedger(b *testing.B, n int) *memLedger {
+	if testing.Short() && n > 100000 {
+		b.Skip("large history skipped in -short mode")
+	}
+	if l, ok := seeded[n]; ok {
+		return l
+	}
+	b.StopTimer()
+	l := newMemLedger()
+	seedReadings(b, l, n)
+	l.index()
+	seeded[n] = l
+	b.StartTimer()
+	return l
+}
+
+func sizeName(n int) string {
+	switch {
+	case n >= 1000000:
+		return fmt.Sprintf("%dM", n/1000000)
+	case n >= 1000:
+		return fmt.Sprintf("%dk", n/1000)
+	}
+	return fmt.Sprint(n)
+}
+
+// readingBytes is the world state taken up by reading keys and values.
+func readingBytes(l *memLedger) (bytes, count int) {
+	for k, v := range l.state {
+		if strings.HasPrefix(k, "\x00reading\x00") {
+			bytes += len(k) + len(v.value)
+			count++
+		}
+	}
+	return bytes, count
+}
+
+func BenchmarkCreateReading(b *testing.B) {
+	l := newMemLedger()
+	c := &SmartContract{}
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		tx := l.newTx()
+		if err := c.CreateReading(tx.ctx(), "AB12", 1717000000000+uint64(i)*5000, uint32(i), sampleBlob); err != nil {
+			b.Fatal(err)
+		}
+		l.commit(tx)
+	}
+	b.StopTimer()
+	bytes, n := readingBytes(l)
+	b.ReportMetric(float64(bytes)/float64(n), "bytes/reading")
+}
+
+func BenchmarkCreateReadings(b *testing.B) {
+	for _, size := range []int{10, 50, 200} {
+		b.Run(fmt.Sprintf("batch=%d", size), func(b *testing.B) {
+			l := newMemLedger()
+			c := &SmartContract{}
+			batch := make([]map[string]any, size)
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				b.StopTimer()
+				for j := range batch {
+					n := i*size + j
+					json.Unmarshal([]byte(sampleBlob), &batch[j])
+					batch[j]["uuid"] = "AB12"
+					batch[j]["timestamp"] = 1717000000000 + uint64(n)*5000
+					batch[j]["seq"] = n
+				}
+				blob, _ := json.Marshal(batch)
+				b.StartTimer()
+
+				tx := l.newTx()
+				if _, err := c.CreateReadings(tx.ctx(), string(blob)); err != nil {
+					b.Fatal(err)
+				}
+				l.commit(tx)
+			}
+			b.StopTimer()
+			b.ReportMetric(float64(b.Elapsed().Nanoseconds())/float64(b.N*size), "ns/reading")
+			bytes, n := readingBytes(l)
+			b.ReportMetric(float64(bytes)/float64(n), "bytes/reading")
+		})
+	}
+}
+
+// readBeforeWrite is CreateReading as a read-modify-write: it checks that
+// the reading key is still free, as the write path used to, and only moves
+// latest~uuid forward. Both reads land in the read set.
+func readBeforeWrite(stub *mockStub, uuid string, ts uint64, seq uint32, jsonBlob string) error {
+	var r SensorReading
+	if err := json.Unmarshal([]byte(jsonBlob), &r); err != nil {
+		return err
+	}
+	r.UUID, r.Timestamp, r.Seq = uuid, ts, seq
+	value, err := encodeReading(&r)
+	if err != nil {
+		return err
+	}
+	key, _ := readingKey(stub, uuid, ts, seq)
+	if v, _ := stub.GetState(key); v != nil {
+		return fmt.Errorf("reading exists")
+	}
+	if err := stub.PutState(key, value); err != nil {
+		return err
+	}
+	latestKey, _ := stub.CreateCompositeKey("latest", []string{uuid})
+	if v, _ := stub.GetState(latestKey); v != nil {
+		var prev SensorReading
+		if err := decodeReading(v, &prev); err != nil || prev.Timestamp > ts {
+			return err
+		}
+	}
+	return stub.PutState(latestKey, value)
+}
+
+// BenchmarkConcurrentWrites endorses a block's worth of submissions for one
+// device against the same state, as concurrent clients would, then commits
+// them in order with MVCC validation.
+func BenchmarkConcurrentWrites(b *testing.B) {
+	const perBlock = 50
+	c := &SmartContract{}
+	paths := []struct {
+		name  string
+		write func(tx *mockStub, ts uint64, seq uint32) error
+	}{
+		{"blind", func(tx *mockStub, ts uint64, seq uint32) error {
+			return c.CreateReading(tx.ctx(), "AB12", ts, seq, sampleBlob)
+		}},
+		{"readBeforeWrite", func(tx *mockStub, ts uint64, seq uint32) error {
+			return readBeforeWrite(tx, "AB12", ts, seq, sampleBlob)
+		}},
+	}
+	for _, p := range paths {
+		b.Run(p.name, func(b *testing.B) {
+			l := newMemLedger()
+			seedReadings(b, l, 1)
+			txs := make([]*mockStub, perBlock)
+			committed := 0
+			b.ReportAllocs()
+			b.ResetTimer()
+			start := time.Now()
+			for i := 0; i < b.N; i++ {
+				for j := range txs {
+					n := i*perBlock + j
+					txs[j] = l.newTx()
+					if err := p.write(txs[j], 1717000005000+uint64(n), uint32(n)); err != nil {
+						b.Fatal(err)
+					}
+				}
+				committed += countValid(l.commit(txs...))
+			}
+			elapsed := time.Since(start)
+			b.ReportMetric(100*float64(committed)/float64(b.N*perBlock), "commit%")
+			b.ReportMetric(float64(committed)/elapsed.Seconds(), "tx/s")
+		})
+	}
+}
+
+func BenchmarkGetReading(b *testing.B) {
+	c := &SmartContract{}
+	for _, n := range historySizes {
+		b.Run(sizeName(n), func(b *testing.B) {
+			l := seededLedger(b, n)
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				ts := sampleReading(i * 7919 % n).Timestamp
+				if _, err := c.GetReading(l.newTx().ctx(), "AB12", ts); err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+	}
+}
+
+// The query paths on the GUI's ten-minute window (120 readings) at the end
+// of the history. Structs is the path QueryDeviceRange replaced: decode
+// every row into a struct and let encoding/json marshal the slice.
+func BenchmarkQueryWindow(b *testing.B) {
+	c := &SmartContract{}
+	paths := []struct {
+		name  string
+		query func(tx *mockStub, from, to uint64) (int, error)
+	}{
+		{"Range", func(tx *mockStub, from, to uint64) (int, error) {
+			out, err := c.QueryDeviceRange(tx.ctx(), "AB12", from, to, 0, "")
+			return len(out), err
+		}},
+		{"Raw", func(tx *mockStub, from, to uint64) (int, error) {
+			out, err := c.QueryDeviceRaw(tx.ctx(), "AB12", from, to, 0, "")
+			return len(out), err
+		}},
+		{"Structs", func(tx *mockStub, from, to uint64) (int, error) {
+			var list []*SensorReading
+			_, err := streamRange(tx, "AB12", from, to, maxPageSize, "",
+				func(value []byte) error {
+					r := new(SensorReading)
+					list = append(list, r)
+					return decodeReading(value, r)
+				})
+			if err != nil {
+				return 0, err
+			}
+			out, err := json.Marshal(list)
+			return len(out), err
+		}},
+	}
+	for _, n := range historySizes {
+		for _, p := range paths {
+			b.Run(sizeName(n)+"/"+p.name, func(b *testing.B) {
+				l := seededLedger(b, n)
+				to := sampleReading(n - 1).Timestamp
+				from := to - 10*60*1000 + 1
+				b.ReportAllocs()
+				size := 0
+				for i := 0; i < b.N; i++ {
+					var err error
+					if size, err = p.query(l.newTx(), from, to); err != nil {
+						b.Fatal(err)
+					}
+				}
+				b.ReportMetric(float64(size), "bytes/op_out")
+			})
+		}
+	}
+}
+
+func BenchmarkFindDuplicates(b *testing.B) {
+	c := &SmartContract{}
+	for _, n := range historySizes[:2] {
+		b.Run(sizeName(n), func(b *testing.B) {
+			l := seededLedger(b, n)
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				if _, err := c.FindDuplicates(l.newTx().ctx(), "AB12", 0, ^uint64(0)); err != nil {
+					b.Fatal(err)
+				}
+			}
+			b.ReportMetric(float64(b.Elapsed().Nanoseconds())/float64(b.N*n), "ns/reading")
+		})
+	}
+}
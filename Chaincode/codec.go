@@ -0,0 +1,154 @@
+package main
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+	"math"
+	"strconv"
+)
+
+// Ledger values are stored in a fixed binary layout instead of the JSON the
+// gateway submits. Field names and float text were most of every value, and
+// decoding JSON per row dominated query CPU.
+//
+// v1 layout, big endian:
+//
+//	off  size  field
+//	  0     1  version (1)
+//	  1     8  timestamp
+//	  9     4  seq
+//	 13     8  pressure    (float64 bits)
+//	 21     8  humidity    (float64 bits)
+//	 29     8  temperature (float64 bits)
+//	 37     3  r, g, b
+//	 40     2  tvoc
+//	 42     3  accel_x, accel_y, accel_z
+//	 45     1  len(uuid)
+//	 46     n  uuid
+//
+// Values written before the binary format start with '{' and are still
+// decoded as JSON, so old rows stay readable without a migration.
+
+const (
+	codecV1     = 1
+	v1FixedSize = 46
+)
+
+func encodeReading(r *SensorReading) ([]byte, error) {
+	if len(r.UUID) > math.MaxUint8 {
+		return nil, fmt.Errorf("uuid %q too long", r.UUID)
+	}
+	b := make([]byte, v1FixedSize+len(r.UUID))
+	b[0] = codecV1
+	binary.BigEndian.PutUint64(b[1:], r.Timestamp)
+	binary.BigEndian.PutUint32(b[9:], r.Seq)
+	binary.BigEndian.PutUint64(b[13:], math.Float64bits(r.Pressure))
+	binary.BigEndian.PutUint64(b[21:], math.Float64bits(r.Humidity))
+	binary.BigEndian.PutUint64(b[29:], math.Float64bits(r.Temperature))
+	b[37], b[38], b[39] = r.R, r.G, r.B
+	binary.BigEndian.PutUint16(b[40:], r.TVOC)
+	b[42], b[43], b[44] = byte(r.AccelX), byte(r.AccelY), byte(r.AccelZ)
+	b[45] = byte(len(r.UUID))
+	copy(b[v1FixedSize:], r.UUID)
+	return b, nil
+}
+
+// decodeReading is the single place stored values are turned back into
+// readings, whatever format they were written in.
+func decodeReading(b []byte, r *SensorReading) error {
+	if len(b) == 0 {
+		return fmt.Errorf("empty reading value")
+	}
+	switch b[0] {
+	case '{':
+		return json.Unmarshal(b, r)
+	case codecV1:
+		if len(b) < v1FixedSize || len(b) != v1FixedSize+int(b[45]) {
+			return fmt.Errorf("truncated v1 reading (%d bytes)", len(b))
+		}
+		r.Timestamp = binary.BigEndian.Uint64(b[1:])
+		r.Seq = binary.BigEndian.Uint32(b[9:])
+		r.Pressure = math.Float64frombits(binary.BigEndian.Uint64(b[13:]))
+		r.Humidity = math.Float64frombits(binary.BigEndian.Uint64(b[21:]))
+		r.Temperature = math.Float64frombits(binary.BigEndian.Uint64(b[29:]))
+		r.R, r.G, r.B = b[37], b[38], b[39]
+		r.TVOC = binary.BigEndian.Uint16(b[40:])
+		r.AccelX, r.AccelY, r.AccelZ = int8(b[42]), int8(b[43]), int8(b[44])
+		r.UUID = string(b[v1FixedSize:])
+		return nil
+	default:
+		return fmt.Errorf("unknown reading format version %d", b[0])
+	}
+}
+
+// appendReadingJSON renders r exactly as encoding/json would (same field
+// order and number formatting) without reflection or allocation beyond
+// growing dst.
+func appendReadingJSON(dst []byte, r *SensorReading) []byte {
+	dst = append(dst, `{"uuid":`...)
+	dst = appendJSONString(dst, r.UUID)
+	dst = append(dst, `,"timestamp":`...)
+	dst = strconv.AppendUint(dst, r.Timestamp, 10)
+	dst = append(dst, `,"seq":`...)
+	dst = strconv.AppendUint(dst, uint64(r.Seq), 10)
+	dst = append(dst, `,"pressure":`...)
+	dst = appendJSONFloat(dst, r.Pressure)
+	dst = append(dst, `,"humidity":`...)
+	dst = appendJSONFloat(dst, r.Humidity)
+	dst = append(dst, `,"temperature":`...)
+	dst = appendJSONFloat(dst, r.Temperature)
+	dst = append(dst, `,"r":`...)
+	dst = strconv.AppendUint(dst, uint64(r.R), 10)
+	dst = append(dst, `,"g":`...)
+	dst = strconv.AppendUint(dst, uint64(r.G), 10)
+	dst = append(dst, `,"b":`...)
+	dst = strconv.AppendUint(dst, uint64(r.B), 10)
+	dst = append(dst, `,"tvoc":`...)
+	dst = strconv.AppendUint(dst, uint64(r.TVOC), 10)
+	dst = append(dst, `,"accel_x":`...)
+	dst = strconv.AppendInt(dst, int64(r.AccelX), 10)
+	dst = append(dst, `,"accel_y":`...)
+	dst = strconv.AppendInt(dst, int64(r.AccelY), 10)
+	dst = append(dst, `,"accel_z":`...)
+	dst = strconv.AppendInt(dst, int64(r.AccelZ), 10)
+	return append(dst, '}')
+}
+
+// appendValueJSON appends one stored value as JSON. Legacy JSON rows are
+// copied through untouched; binary rows are rendered by appendReadingJSON.
+func appendValueJSON(dst []byte, value []byte) ([]byte, error) {
+	if len(value) > 0 && value[0] == '{' {
+		return append(dst, value...), nil
+	}
+	var r SensorReading
+	if err := decodeReading(value, &r); err != nil {
+		return dst, err
+	}
+	return appendReadingJSON(dst, &r), nil
+}
+
+func appendJSONFloat(dst []byte, f float64) []byte {
+	format := byte('f')
+	if abs := math.Abs(f); abs != 0 && (abs < 1e-6 || abs >= 1e21) {
+		format = 'e'
+	}
+	dst = strconv.AppendFloat(dst, f, format, -1, 64)
+	if n := len(dst); format == 'e' && dst[n-4] == 'e' && dst[n-3] == '-' && dst[n-2] == '0' {
+		dst[n-2] = dst[n-1] // e-09 -> e-9, as encoding/json does
+		dst = dst[:n-1]
+	}
+	return dst
+}
+
+func appendJSONString(dst []byte, s string) []byte {
+	for i := 0; i < len(s); i++ {
+		if c := s[i]; c < 0x20 || c >= 0x7f || c == '"' || c == '\\' || c == '<' || c == '>' || c == '&' {
+			b, _ := json.Marshal(s) // rare: let encoding/json do the escaping
+			return append(dst, b...)
+		}
+	}
+	dst = append(dst, '"')
+	dst = append(dst, s...)
+	return append(dst, '"')
+}
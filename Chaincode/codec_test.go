@@ -0,0 +1,93 @@
+package main
+
+import (
+	"encoding/json"
+	"testing"
+)
+
+func sampleReading(i int) *SensorReading {
+	return &SensorReading{
+		UUID: "AB12", Timestamp: 1717000000000 + uint64(i)*5000, Seq: uint32(i),
+		Pressure: 101, Humidity: 63, Temperature: 5,
+		R: 120, G: 98, B: 77, TVOC: 231,
+		AccelX: -2, AccelY: 1, AccelZ: 9,
+	}
+}
+
+func TestCodecRoundTrip(t *testing.T) {
+	in := sampleReading(42)
+	b, err := encodeReading(in)
+	if err != nil {
+		t.Fatal(err)
+	}
+	var out SensorReading
+	if err := decodeReading(b, &out); err != nil {
+		t.Fatal(err)
+	}
+	if out != *in {
+		t.Fatalf("round trip: got %+v want %+v", out, *in)
+	}
+
+	// Rows written before the binary format still decode.
+	legacy, _ := json.Marshal(in)
+	out = SensorReading{}
+	if err := decodeReading(legacy, &out); err != nil || out != *in {
+		t.Fatalf("legacy JSON: got %+v, %v", out, err)
+	}
+}
+
+func TestAppendReadingJSONMatchesEncodingJSON(t *testing.T) {
+	for _, r := range []*SensorReading{
+		sampleReading(7),
+		{UUID: `q"\\<x>`, Pressure: 1e-9, Humidity: 1e22, Temperature: -3.25},
+	} {
+		want, _ := json.Marshal(r)
+		if got := appendReadingJSON(nil, r); string(got) != string(want) {
+			t.Errorf("got  %s\nwant %s", got, want)
+		}
+	}
+}
+
+func BenchmarkDecodeBinary(b *testing.B) {
+	val, _ := encodeReading(sampleReading(1))
+	b.ReportMetric(float64(len(val)), "bytes/reading")
+	b.ReportAllocs()
+	var r SensorReading
+	for i := 0; i < b.N; i++ {
+		if err := decodeReading(val, &r); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkDecodeJSON(b *testing.B) {
+	val, _ := json.Marshal(sampleReading(1))
+	b.ReportMetric(float64(len(val)), "bytes/reading")
+	b.ReportAllocs()
+	var r SensorReading
+	for i := 0; i < b.N; i++ {
+		if err := decodeReading(val, &r); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkEncodeBinary(b *testing.B) {
+	r := sampleReading(1)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := encodeReading(r); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkEncodeJSON(b *testing.B) {
+	r := sampleReading(1)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := json.Marshal(r); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
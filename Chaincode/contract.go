@@ -1,15 +1,21 @@
 package main
 
 import (
+	"encoding/binary"
 	"encoding/json"
 	"fmt"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
 	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
-	"strconv"
+	"math"
+	"sort"
+	"strings"
+	"unicode/utf8"
 )
 
 type SensorReading struct {
 	UUID        string  `json:"uuid"`
 	Timestamp   uint64  `json:"timestamp"`
+	Seq         uint32  `json:"seq"`
 	Pressure    float64 `json:"pressure"`
 	Humidity    float64 `json:"humidity"`
 	Temperature float64 `json:"temperature"`
@@ -24,74 +30,490 @@ type SensorReading struct {
 
 type SmartContract struct{ contractapi.Contract }
 
-// key = reading~uuid~timestamp for fast range scans
+// key = reading~uuid~timestamp~seq for fast range scans (see keys.go)
+// latest~uuid holds a copy of the last reading written so the display poll
+// is a single point read instead of a scan over the whole history; see
+// putLatest for what "last" means. pending~uuid~timestamp~seq queues the
+// reading for CompactDevice.
+//
+// All writes are blind: nothing is read first, so no key enters the
+// transaction's read set and concurrent submissions for the same device
+// cannot fail MVCC validation. The only keys read are ones that are
+// written once or rarely (limits, the device registry entry). A replayed
+// reading lands on the same key with the same bytes; duplicates that
+// slipped in under a new timestamp are found afterwards with
+// FindDuplicates.
 func (s *SmartContract) CreateReading(ctx contractapi.TransactionContextInterface,
-	uuid string, ts uint64, jsonBlob string) error {
+	uuid string, ts uint64, seq uint32, jsonBlob string) error {
 
-	key, _ := ctx.GetStub().
-		CreateCompositeKey("reading", []string{uuid, strconv.FormatUint(ts, 10)})
+	var r SensorReading
+	if err := json.Unmarshal([]byte(jsonBlob), &r); err != nil {
+		return err
+	}
+	r.UUID, r.Timestamp, r.Seq = uuid, ts, seq
+
+	value, err := encodeReading(&r)
+	if err != nil {
+		return err
+	}
+	if err := putReading(ctx.GetStub(), &r, value, limitsCache{}); err != nil {
+		return err
+	}
+	if err := registerDevice(ctx.GetStub(), uuid, ts); err != nil {
+		return err
+	}
+	if err := putLatest(ctx.GetStub(), uuid, value); err != nil {
+		return err
+	}
+	return emitLatest(ctx.GetStub(), [][]byte{value})
+}
+
+// ItemResult reports the outcome of one entry of a CreateReadings batch.
+type ItemResult struct {
+	Index int    `json:"index"`
+	Error string `json:"error,omitempty"`
+}
+
+// CreateReadings writes a JSON array of readings in one transaction, so a
+// batch costs one endorsement/ordering/validation round instead of one per
+// reading. Entries that fail validation are skipped and reported in their
+// ItemResult; the rest are committed.
+func (s *SmartContract) CreateReadings(ctx contractapi.TransactionContextInterface,
+	batchJson string) ([]*ItemResult, error) {
+
+	var raws []json.RawMessage
+	if err := json.Unmarshal([]byte(batchJson), &raws); err != nil {
+		return nil, fmt.Errorf("batch is not a JSON array: %v", err)
+	}
+
+	stub := ctx.GetStub()
+	results := make([]*ItemResult, len(raws))
+	newest := make(map[string]int)    // uuid -> index of its newest reading
+	oldest := make(map[string]uint64) // uuid -> its oldest timestamp
+	readings := make([]SensorReading, len(raws))
+	values := make([][]byte, len(raws))
+	limits := limitsCache{}
 
-	if v, _ := ctx.GetStub().GetState(key); v != nil {
-		return fmt.Errorf("reading exists")
+	for i, raw := range raws {
+		results[i] = &ItemResult{Index: i}
+		r := &readings[i]
+		if err := json.Unmarshal(raw, r); err != nil {
+			results[i].Error = err.Error()
+			continue
+		}
+		if err := validateReading(r); err != nil {
+			results[i].Error = err.Error()
+			continue
+		}
+		value, err := encodeReading(r)
+		if err != nil {
+			results[i].Error = err.Error()
+			continue
+		}
+		if err := putReading(stub, r, value, limits); err != nil {
+			return nil, err
+		}
+		values[i] = value
+		if j, ok := newest[r.UUID]; !ok || !newerReading(&readings[j], r) {
+			newest[r.UUID] = i
+		}
+		if t, ok := oldest[r.UUID]; !ok || r.Timestamp < t {
+			oldest[r.UUID] = r.Timestamp
+		}
+	}
+
+	// One registry check and latest~uuid write per device rather than per
+	// reading. Devices go in sorted order so every endorser builds the same
+	// event payload.
+	uuids := make([]string, 0, len(newest))
+	for uuid := range newest {
+		uuids = append(uuids, uuid)
+	}
+	sort.Strings(uuids)
+	latest := make([][]byte, 0, len(uuids))
+	for _, uuid := range uuids {
+		if err := registerDevice(stub, uuid, oldest[uuid]); err != nil {
+			return nil, err
+		}
+		value := values[newest[uuid]]
+		if err := putLatest(stub, uuid, value); err != nil {
+			return nil, err
+		}
+		latest = append(latest, value)
 	}
-	return ctx.GetStub().PutState(key, []byte(jsonBlob))
+	if len(latest) > 0 {
+		if err := emitLatest(stub, latest); err != nil {
+			return nil, err
+		}
+	}
+	return results, nil
+}
+
+func validateReading(r *SensorReading) error {
+	if r.UUID == "" || !utf8.ValidString(r.UUID) || strings.ContainsRune(r.UUID, 0) {
+		return fmt.Errorf("invalid uuid %q", r.UUID)
+	}
+	if r.Timestamp == 0 {
+		return fmt.Errorf("missing timestamp")
+	}
+	return nil
+}
+
+// putReading writes the reading key, its pending~ entry for CompactDevice
+// (see keys.go) and, if the reading is out of the limits that apply to its
+// device, its excursion key (see excursion.go).
+func putReading(stub shim.ChaincodeStubInterface,
+	r *SensorReading, value []byte, limits limitsCache) error {
+
+	key, err := readingKey(stub, r.UUID, r.Timestamp, r.Seq)
+	if err != nil {
+		return err
+	}
+	if err := stub.PutState(key, value); err != nil {
+		return err
+	}
+	pkey, err := pendingKey(stub, r.UUID, r.Timestamp, r.Seq)
+	if err != nil {
+		return err
+	}
+	if err := stub.PutState(pkey, value); err != nil {
+		return err
+	}
+
+	l, err := limits.get(stub, r.UUID)
+	if err != nil {
+		return err
+	}
+	return indexExcursion(stub, r, l)
+}
+
+// putLatest overwrites latest~uuid without reading it, so the pointer is
+// last writer wins: a reading that commits after a newer one (a retried
+// batch, a base node replaying its backlog) moves it back until the
+// device's next write. Comparing first would put the key in every write's
+// read set, the MVCC conflict the blind write path exists to avoid.
+// Consumers that must not go backwards order by (timestamp, seq) with
+// newerReading, as the gateway's latest-value cache does.
+func putLatest(stub shim.ChaincodeStubInterface, uuid string, value []byte) error {
+	key, err := stub.CreateCompositeKey("latest", []string{uuid})
+	if err != nil {
+		return err
+	}
+	return stub.PutState(key, value)
+}
+
+// newerReading orders readings of one device by (timestamp, seq), the
+// order of their keys.
+func newerReading(a, b *SensorReading) bool {
+	if a.Timestamp != b.Timestamp {
+		return a.Timestamp > b.Timestamp
+	}
+	return a.Seq > b.Seq
+}
+
+// emitLatest publishes the new latest~uuid values of a transaction as one
+// "latest" chaincode event, a JSON array in the GetLatestMany format, so
+// the gateway can keep its latest-value cache without querying the peer.
+// Fabric keeps only one event per transaction, hence one call per write.
+func emitLatest(stub shim.ChaincodeStubInterface, values [][]byte) error {
+	buf := make([]byte, 0, 2+len(values)*jsonReadingSize)
+	buf = append(buf, '[')
+	for i, value := range values {
+		if i > 0 {
+			buf = append(buf, ',')
+		}
+		var err error
+		if buf, err = appendValueJSON(buf, value); err != nil {
+			return err
+		}
+	}
+	return stub.SetEvent("latest", append(buf, ']'))
 }
 
 func (s *SmartContract) GetReading(ctx contractapi.TransactionContextInterface,
 	uuid string, ts uint64) (*SensorReading, error) {
 
-	key, _ := ctx.GetStub().
-		CreateCompositeKey("reading", []string{uuid, strconv.FormatUint(ts, 10)})
+	it, err := ctx.GetStub().
+		GetStateByPartialCompositeKey("reading", []string{uuid, tsAttr(ts)})
+	if err != nil {
+		return nil, err
+	}
+	defer it.Close()
 
-	val, err := ctx.GetStub().GetState(key)
-	if err != nil || val == nil {
+	if !it.HasNext() {
 		return nil, fmt.Errorf("not found")
 	}
+	kv, err := it.Next()
+	if err != nil {
+		return nil, err
+	}
 
 	var out SensorReading
-	_ = json.Unmarshal(val, &out)
+	if err := decodeReading(kv.Value, &out); err != nil {
+		return nil, err
+	}
 	return &out, nil
 }
 
-func (s *SmartContract) QueryDevice(ctx contractapi.TransactionContextInterface,
-	uuid string) ([]*SensorReading, error) {
+// GetLatest returns the reading in latest~uuid without touching the
+// device's history, so the cost is independent of how many readings it
+// has. That is its newest reading unless an older one committed after it
+// (see putLatest).
+func (s *SmartContract) GetLatest(ctx contractapi.TransactionContextInterface,
+	uuid string) (*SensorReading, error) {
 
-	it, err := ctx.GetStub().
-		GetStateByPartialCompositeKey("reading", []string{uuid})
+	key, _ := ctx.GetStub().CreateCompositeKey("latest", []string{uuid})
+
+	val, err := ctx.GetStub().GetState(key)
 	if err != nil {
 		return nil, err
 	}
-	defer it.Close()
+	if val == nil {
+		return nil, fmt.Errorf("no readings for %s", uuid)
+	}
+
+	var out SensorReading
+	if err := decodeReading(val, &out); err != nil {
+		return nil, err
+	}
+	return &out, nil
+}
+
+// GetLatestMany is GetLatest for several devices in one round trip. Devices
+// without readings are skipped.
+func (s *SmartContract) GetLatestMany(ctx contractapi.TransactionContextInterface,
+	uuids []string) ([]*SensorReading, error) {
+
+	list := make([]*SensorReading, 0, len(uuids))
+	for _, uuid := range uuids {
+		key, _ := ctx.GetStub().CreateCompositeKey("latest", []string{uuid})
+
+		val, err := ctx.GetStub().GetState(key)
+		if err != nil {
+			return nil, err
+		}
+		if val == nil {
+			continue
+		}
 
-	var list []*SensorReading
-	for it.HasNext() {
-		kv, _ := it.Next()
 		var r SensorReading
-		_ = json.Unmarshal(kv.Value, &r)
+		if err := decodeReading(val, &r); err != nil {
+			return nil, err
+		}
 		list = append(list, &r)
 	}
 	return list, nil
 }
 
+// maxPageSize caps the rows a query returns, or a maintenance call takes, per
+// call. For a device's history use QueryDeviceRange, a page at a time.
+const maxPageSize = 1000
+
+// QueryDeviceRange returns readings of uuid with from <= timestamp <= to,
+// at most pageSize per call, as
+//
+//	{"readings":[...],"bookmark":"..."}
+//
+// Bookmark is empty once the window has been exhausted; otherwise pass it
+// back to get the next page. Stored values are written straight into one
+// preallocated buffer: no per-row structs and no reflection-driven
+// re-marshalling of the page by the contract API.
+func (s *SmartContract) QueryDeviceRange(ctx contractapi.TransactionContextInterface,
+	uuid string, from uint64, to uint64, pageSize int32, bookmark string) (string, error) {
+
+	pageSize = clampPageSize(pageSize)
+	buf := make([]byte, 0, 64+presizeRows(pageSize)*jsonReadingSize)
+	buf = append(buf, `{"readings":[`...)
+	n := 0
+	next, err := streamRange(ctx.GetStub(), uuid, from, to, pageSize, bookmark,
+		func(value []byte) (err error) {
+			if n > 0 {
+				buf = append(buf, ',')
+			}
+			n++
+			buf, err = appendValueJSON(buf, value)
+			return err
+		})
+	if err != nil {
+		return "", err
+	}
+	buf = append(buf, `],"bookmark":`...)
+	buf = appendJSONString(buf, next)
+	return string(append(buf, '}')), nil
+}
+
+// QueryDeviceRaw is QueryDeviceRange without any conversion: the stored
+// values are passed through as a length-prefixed binary stream,
+//
+//	u32 len | bookmark | { u32 len | value }...
+//
+// all lengths big endian. Values are in the codec.go format.
+func (s *SmartContract) QueryDeviceRaw(ctx contractapi.TransactionContextInterface,
+	uuid string, from uint64, to uint64, pageSize int32, bookmark string) (string, error) {
+
+	pageSize = clampPageSize(pageSize)
+	buf := make([]byte, 4, 4+presizeRows(pageSize)*(4+v1FixedSize+8))
+	next, err := streamRange(ctx.GetStub(), uuid, from, to, pageSize, bookmark,
+		func(value []byte) error {
+			buf = binary.BigEndian.AppendUint32(buf, uint32(len(value)))
+			buf = append(buf, value...)
+			return nil
+		})
+	if err != nil {
+		return "", err
+	}
+
+	// The bookmark is only known once the page is read; put it in front.
+	out := make([]byte, 0, len(buf)+len(next))
+	out = binary.BigEndian.AppendUint32(out, uint32(len(next)))
+	out = append(out, next...)
+	out = append(out, buf[4:]...)
+	return string(out), nil
+}
+
+// rough size of one reading rendered as JSON, for preallocation
+const jsonReadingSize = 192
+
+// presizeRows is how many rows a result buffer is allocated for up front.
+// Most calls are short windows (the GUI's ten minutes is 120 readings), so
+// buffers start at that size and let append grow them for full pages
+// rather than zeroing a maxPageSize buffer every time.
+func presizeRows(pageSize int32) int {
+	if pageSize > 128 {
+		return 128
+	}
+	return int(pageSize)
+}
+
+func clampPageSize(pageSize int32) int32 {
+	if pageSize <= 0 || pageSize > maxPageSize {
+		return maxPageSize
+	}
+	return pageSize
+}
+
+// streamRange hands the stored value of each reading of uuid with
+// from <= timestamp <= to to emit, in time order, reading at most one page.
+// It returns the bookmark of the next page, or "" when the window is done.
+// Because timestamps are fixed width in the key, the scan starts at the
+// first key of the window and stops at the first key past it; nothing
+// outside the window is read.
+//
+// The first page starts at the window's lower edge. A bookmark from the
+// caller is handed to the peer as it is; it is only checked to lie inside
+// this device's window, so it cannot page through another device's keys.
+func streamRange(stub shim.ChaincodeStubInterface, uuid string, from, to uint64,
+	pageSize int32, bookmark string, emit func(value []byte) error) (string, error) {
+
+	start, err := readingPrefix(stub, uuid, from)
+	if err != nil {
+		return "", err
+	}
+	end := ""
+	if to < math.MaxUint64 {
+		if end, err = readingPrefix(stub, uuid, to+1); err != nil {
+			return "", err
+		}
+	}
+	if bookmark == "" {
+		bookmark = start
+	} else {
+		prefix, err := stub.CreateCompositeKey("reading", []string{uuid})
+		if err != nil {
+			return "", err
+		}
+		if !strings.HasPrefix(bookmark, prefix) || bookmark < start || (end != "" && bookmark >= end) {
+			return "", fmt.Errorf("bookmark is outside %s's window [%d, %d]", uuid, from, to)
+		}
+	}
+
+	it, meta, err := stub.GetStateByPartialCompositeKeyWithPagination(
+		"reading", []string{uuid}, pageSize, bookmark)
+	if err != nil {
+		return "", err
+	}
+	defer it.Close()
+
+	for it.HasNext() {
+		kv, err := it.Next()
+		if err != nil {
+			return "", err
+		}
+		if end != "" && kv.Key >= end {
+			return "", nil
+		}
+		if err := emit(kv.Value); err != nil {
+			return "", err
+		}
+	}
+	return meta.Bookmark, nil
+}
+
+// FindDuplicates reports readings of uuid in [from, to] that carry the same
+// device sequence number as the reading before them, i.e. a base node
+// replaying an advert. It runs as a query, off the write path, so the
+// writes themselves can stay blind.
+func (s *SmartContract) FindDuplicates(ctx contractapi.TransactionContextInterface,
+	uuid string, from uint64, to uint64) ([]*SensorReading, error) {
+
+	stub := ctx.GetStub()
+	start, err := readingPrefix(stub, uuid, from)
+	if err != nil {
+		return nil, err
+	}
+
+	var dups []*SensorReading
+	var prev *SensorReading
+	err = scanFrom(stub, "reading", []string{uuid}, start,
+		func(_ string, value []byte) (bool, error) {
+			var r SensorReading
+			if err := decodeReading(value, &r); err != nil {
+				return false, err
+			}
+			if r.Timestamp > to {
+				return false, nil
+			}
+			if prev != nil && prev.Seq == r.Seq {
+				dups = append(dups, &r)
+			}
+			prev = &r
+			return true, nil
+		})
+	if err != nil {
+		return nil, err
+	}
+	return dups, nil
+}
+
+// DeleteReading removes every reading of uuid stamped ts.
 func (s *SmartContract) DeleteReading(
 	ctx contractapi.TransactionContextInterface,
 	uuid string, ts uint64,
 ) error {
 
-	key, _ := ctx.GetStub().
-		CreateCompositeKey("reading",
-			[]string{uuid, strconv.FormatUint(ts, 10)}) // build the same key
-
-	// Check the record really exists – saves silent no-op deletes.
-	val, err := ctx.GetStub().GetState(key)
+	it, err := ctx.GetStub().
+		GetStateByPartialCompositeKey("reading", []string{uuid, tsAttr(ts)})
 	if err != nil {
 		return err
 	}
-	if val == nil {
-		return fmt.Errorf("reading %s not found", key)
-	}
+	defer it.Close()
 
-	return ctx.GetStub().DelState(key) // physical delete in world-state DB
+	n := 0
+	for it.HasNext() {
+		kv, err := it.Next()
+		if err != nil {
+			return err
+		}
+		if err := ctx.GetStub().DelState(kv.Key); err != nil { // physical delete in world-state DB
+			return err
+		}
+		n++
+	}
+	// Check the record really existed – saves silent no-op deletes.
+	if n == 0 {
+		return fmt.Errorf("reading %s@%d not found", uuid, ts)
+	}
+	return nil
 }
 
 func main() {
@@ -0,0 +1,374 @@
+package main
+
+import (
+	"encoding/json"
+	"math"
+	"testing"
+)
+
+const sampleBlob = `{"pressure":101,"humidity":63,"temperature":5,"r":120,"g":98,"b":77,` +
+	`"tvoc":231,"accel_x":-2,"accel_y":1,"accel_z":9}`
+
+// seedReadings commits n readings of sampleReading's device, 5 s apart, in
+// one block.
+func seedReadings(t testing.TB, l *memLedger, n int) {
+	tx := l.newTx()
+	limits := limitsCache{}
+	for i := 0; i < n; i++ {
+		r := sampleReading(i)
+		value, err := encodeReading(r)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if err := putReading(tx, r, value, limits); err != nil {
+			t.Fatal(err)
+		}
+		if i == n-1 {
+			if err := putLatest(tx, r.UUID, value); err != nil {
+				t.Fatal(err)
+			}
+		}
+	}
+	if err := registerDevice(tx, "AB12", sampleReading(0).Timestamp); err != nil {
+		t.Fatal(err)
+	}
+	l.commit(tx)
+}
+
+func TestQueryDeviceRangePages(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 2500)
+	c := &SmartContract{}
+
+	from, to := sampleReading(100).Timestamp, sampleReading(2299).Timestamp
+	var got []*SensorReading
+	pages := 0
+	for bookmark := ""; pages == 0 || bookmark != ""; pages++ {
+		out, err := c.QueryDeviceRange(l.newTx().ctx(), "AB12", from, to, 1000, bookmark)
+		if err != nil {
+			t.Fatal(err)
+		}
+		var page struct {
+			Readings []*SensorReading `json:"readings"`
+			Bookmark string           `json:"bookmark"`
+		}
+		if err := json.Unmarshal([]byte(out), &page); err != nil {
+			t.Fatal(err)
+		}
+		got = append(got, page.Readings...)
+		bookmark = page.Bookmark
+	}
+	if len(got) != 2200 || pages != 3 {
+		t.Fatalf("got %d readings in %d pages, want 2200 in 3", len(got), pages)
+	}
+	for i, r := range got {
+		if *r != *sampleReading(100 + i) {
+			t.Fatalf("reading %d: got %+v", i, r)
+		}
+	}
+}
+
+func TestQueryDeviceRangeRejectsForeignBookmark(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 10)
+	c := &SmartContract{}
+
+	other, _ := readingKey(l.newTx(), "CD34", sampleReading(5).Timestamp, 5)
+	early, _ := readingPrefix(l.newTx(), "AB12", sampleReading(1).Timestamp)
+	late, _ := readingPrefix(l.newTx(), "AB12", sampleReading(9).Timestamp)
+	from, to := sampleReading(2).Timestamp, sampleReading(8).Timestamp
+	for name, bookmark := range map[string]string{"other device": other, "before from": early, "after to": late} {
+		if _, err := c.QueryDeviceRange(l.newTx().ctx(), "AB12", from, to, 5, bookmark); err == nil {
+			t.Fatalf("%s: bookmark accepted", name)
+		}
+	}
+	// With no upper bound the device prefix is all that fences the scan.
+	if _, err := c.QueryDeviceRaw(l.newTx().ctx(), "AB12", 0, math.MaxUint64, 5, other); err == nil {
+		t.Fatal("other device's bookmark accepted by an unbounded query")
+	}
+}
+
+func TestQueryExcursionsAllReadsOnlyTheWindow(t *testing.T) {
+	l := newMemLedger()
+	c := &SmartContract{}
+	tx := l.newTx()
+	for _, uuid := range []string{"AB12", "CD34"} {
+		if err := c.SetLimits(tx.ctx(), uuid, `{"channels":{"temperature":{"max":4}}}`); err != nil {
+			t.Fatal(err)
+		}
+	}
+	l.commit(tx)
+
+	// Every reading is 5 °C, so every one is an excursion.
+	tx = l.newTx()
+	limits := limitsCache{}
+	for i := 0; i < 1000; i++ {
+		for _, uuid := range []string{"AB12", "CD34"} {
+			r := sampleReading(i)
+			r.UUID = uuid
+			value, err := encodeReading(r)
+			if err != nil {
+				t.Fatal(err)
+			}
+			if err := putReading(tx, r, value, limits); err != nil {
+				t.Fatal(err)
+			}
+		}
+	}
+	l.commit(tx)
+
+	tx = l.newTx()
+	got, err := c.QueryExcursions(tx.ctx(), "all", sampleReading(900).Timestamp, sampleReading(909).Timestamp)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(got) != 20 {
+		t.Fatalf("got %d excursions, want 20", len(got))
+	}
+	for i, e := range got {
+		if want := sampleReading(900 + i/2).Timestamp; e.Timestamp != want {
+			t.Fatalf("excursion %d at %d, want %d", i, e.Timestamp, want)
+		}
+	}
+	read := 0
+	for _, r := range tx.ranges {
+		read += len(r.keys)
+	}
+	if read > 21 {
+		t.Fatalf("read %d keys for 20 excursions", read)
+	}
+}
+
+func TestBlindWritesDoNotConflict(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 1)
+	c := &SmartContract{}
+
+	// Ten submissions for one device endorsed against the same state and
+	// ordered into one block, first blind, then read-before-write.
+	var blind, rbw []*mockStub
+	for i := 0; i < 10; i++ {
+		tx := l.newTx()
+		if err := c.CreateReading(tx.ctx(), "AB12", 1717100000000+uint64(i), uint32(i), sampleBlob); err != nil {
+			t.Fatal(err)
+		}
+		blind = append(blind, tx)
+	}
+	if n := countValid(l.commit(blind...)); n != 10 {
+		t.Fatalf("blind writes: %d of 10 committed", n)
+	}
+
+	for i := 0; i < 10; i++ {
+		tx := l.newTx()
+		if err := readBeforeWrite(tx, "AB12", 1717200000000+uint64(i), uint32(i), sampleBlob); err != nil {
+			t.Fatal(err)
+		}
+		rbw = append(rbw, tx)
+	}
+	if n := countValid(l.commit(rbw...)); n != 1 {
+		t.Fatalf("read-before-write: %d of 10 committed, want 1", n)
+	}
+}
+
+func TestCreateReadingsEmitsLatest(t *testing.T) {
+	l := newMemLedger()
+	c := &SmartContract{}
+
+	batch := []*SensorReading{sampleReading(2), sampleReading(1), sampleReading(0)}
+	batch[2].UUID = "CD34"
+	blob, _ := json.Marshal(batch)
+	tx := l.newTx()
+	if _, err := c.CreateReadings(tx.ctx(), string(blob)); err != nil {
+		t.Fatal(err)
+	}
+
+	var got []*SensorReading
+	if err := json.Unmarshal(tx.eventPayload, &got); err != nil || tx.eventName != "latest" {
+		t.Fatalf("event %q %s: %v", tx.eventName, tx.eventPayload, err)
+	}
+	if len(got) != 2 || *got[0] != *batch[0] || *got[1] != *batch[2] {
+		t.Fatalf("event payload %s", tx.eventPayload)
+	}
+}
+
+func TestCompactDeviceResumesFromCursor(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 2500)
+	c := &SmartContract{}
+	l.clock = l.clock.Add(24 * 3600 * 1000 * 1e6)
+
+	// More than a page of readings, folded in bounded runs; each run writes
+	// its rollups and cursor, so it must be a transaction a peer endorses.
+	runs := 0
+	for more := true; more; runs++ {
+		tx := l.newTx()
+		res, err := c.CompactDevice(tx.ctx(), "AB12", 600)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if n := countValid(l.commit(tx)); n != 1 {
+			t.Fatalf("run %d did not commit", runs)
+		}
+		more = res.More
+	}
+	if runs != 5 {
+		t.Fatalf("compacted in %d runs, want 5", runs)
+	}
+
+	rollups, err := c.QueryRollups(l.newTx().ctx(), "AB12", "day", 0, math.MaxUint64)
+	if err != nil {
+		t.Fatal(err)
+	}
+	var count uint64
+	for _, ru := range rollups {
+		count += ru.Count
+	}
+	if count != 2500 {
+		t.Fatalf("rollups count %d readings, want 2500", count)
+	}
+}
+
+func TestCompactDeviceReadsOnlyPending(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 2500)
+	c := &SmartContract{}
+	l.clock = l.clock.Add(24 * 3600 * 1000 * 1e6)
+	compact := func() (*CompactResult, int) {
+		tx := l.newTx()
+		res, err := c.CompactDevice(tx.ctx(), "AB12", 0)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if n := countValid(l.commit(tx)); n != 1 {
+			t.Fatal("compaction did not commit")
+		}
+		read := 0
+		for _, r := range tx.ranges {
+			read += len(r.keys)
+		}
+		return res, read
+	}
+	for more := true; more; {
+		res, _ := compact()
+		more = res.More
+	}
+
+	// More history than a page is folded already. Ten new readings and one
+	// that commits late, in the middle of that history: compaction reads
+	// those eleven keys and nothing else.
+	tx := l.newTx()
+	late := sampleReading(1000)
+	late.Seq = 99999
+	batch := []*SensorReading{late}
+	for i := 2500; i < 2510; i++ {
+		batch = append(batch, sampleReading(i))
+	}
+	blob, _ := json.Marshal(batch)
+	if _, err := c.CreateReadings(tx.ctx(), string(blob)); err != nil {
+		t.Fatal(err)
+	}
+	l.commit(tx)
+
+	res, read := compact()
+	if res.Folded != 11 || res.More || read != 11 {
+		t.Fatalf("folded %d (more %v), read %d keys; want 11, 11", res.Folded, res.More, read)
+	}
+	hour := late.Timestamp - late.Timestamp%(3600*1000)
+	rollups, err := c.QueryRollups(l.newTx().ctx(), "AB12", "hour", hour, hour)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(rollups) != 1 || rollups[0].Count != 721 {
+		t.Fatalf("late reading's hour: %+v", rollups)
+	}
+}
+
+func TestPruneDeviceKeepsPendingReadings(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 100)
+	c := &SmartContract{}
+	l.clock = l.clock.Add(24 * 3600 * 1000 * 1e6)
+	prune := func(before uint64, maxKeys int32) (deleted, kept, calls int) {
+		for bookmark, more := "", true; more; calls++ {
+			tx := l.newTx()
+			res, err := c.PruneDevice(tx.ctx(), "AB12", before, maxKeys, bookmark)
+			if err != nil {
+				t.Fatal(err)
+			}
+			if n := countValid(l.commit(tx)); n != 1 {
+				t.Fatalf("call %d did not commit", calls)
+			}
+			deleted, kept = deleted+res.Deleted, kept+res.Kept
+			bookmark, more = res.Bookmark, res.More
+		}
+		return
+	}
+
+	tx := l.newTx()
+	if _, err := c.CompactDevice(tx.ctx(), "AB12", 40); err != nil {
+		t.Fatal(err)
+	}
+	l.commit(tx)
+
+	// Bounded calls, each resuming at the bookmark of the one before; the
+	// 50 expired readings not folded yet stay.
+	if deleted, kept, calls := prune(sampleReading(90).Timestamp, 30); deleted != 40 || kept != 50 || calls != 3 {
+		t.Fatalf("deleted %d, kept %d in %d calls; want 40, 50 in 3", deleted, kept, calls)
+	}
+	for i := 0; i < 100; i++ {
+		_, err := c.GetReading(l.newTx().ctx(), "AB12", sampleReading(i).Timestamp)
+		if gone := err != nil; gone != (i < 40) {
+			t.Fatalf("reading %d: gone %v", i, gone)
+		}
+	}
+
+	// A reading that commits late, among the pruned ones, is kept until
+	// CompactDevice has folded it.
+	tx = l.newTx()
+	late := sampleReading(10)
+	blob, _ := json.Marshal([]*SensorReading{late})
+	if _, err := c.CreateReadings(tx.ctx(), string(blob)); err != nil {
+		t.Fatal(err)
+	}
+	l.commit(tx)
+	if deleted, kept, _ := prune(sampleReading(40).Timestamp, 0); deleted != 0 || kept != 1 {
+		t.Fatalf("late reading: deleted %d, kept %d before compaction", deleted, kept)
+	}
+
+	tx = l.newTx()
+	cres, err := c.CompactDevice(tx.ctx(), "AB12", 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	l.commit(tx)
+	if cres.Folded != 61 {
+		t.Fatalf("compacted %d after prune, want 61", cres.Folded)
+	}
+	if deleted, kept, _ := prune(sampleReading(40).Timestamp, 0); deleted != 1 || kept != 0 {
+		t.Fatalf("late reading: deleted %d, kept %d after compaction", deleted, kept)
+	}
+}
+
+func TestWriteAfterPaginatedQueryFails(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 10)
+	c := &SmartContract{}
+
+	tx := l.newTx()
+	if _, err := c.QueryDeviceRange(tx.ctx(), "AB12", 0, math.MaxUint64, 5, ""); err != nil {
+		t.Fatal(err)
+	}
+	if err := c.CreateReading(tx.ctx(), "AB12", 1717100000000, 1, sampleBlob); err != errPaginatedWrite {
+		t.Fatalf("write after a paginated query: got %v", err)
+	}
+}
+
+func countValid(valid []bool) int {
+	n := 0
+	for _, ok := range valid {
+		if ok {
+			n++
+		}
+	}
+	return n
+}
@@ -0,0 +1,200 @@
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
+	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
+)
+
+// Out-of-spec readings are indexed as they are written, so compliance
+// queries scan only the breaches instead of every reading:
+//
+//	limits~uuid               -> Limits for one device
+//	limits~product:<name>     -> Limits shared by a product line
+//	excursion~uuid~ts~seq     -> Excursion
+//	excursionts~ts~uuid~seq   -> Excursion, the same, in time order
+//
+// A device's Limits may just name a Product, in which case that product's
+// channel limits apply. Limits change rarely, so reading them on the write
+// path does not bring back MVCC conflicts; the excursion keys themselves
+// are blind inserts like the reading. The second copy is what lets a query
+// across every device start at its window instead of at the first device.
+
+type Range struct {
+	Min *float64 `json:"min,omitempty"`
+	Max *float64 `json:"max,omitempty"`
+}
+
+type Limits struct {
+	Product  string           `json:"product,omitempty"`
+	Channels map[string]Range `json:"channels,omitempty"`
+}
+
+type Breach struct {
+	Channel string   `json:"channel"`
+	Value   float64  `json:"value"`
+	Min     *float64 `json:"min,omitempty"`
+	Max     *float64 `json:"max,omitempty"`
+}
+
+type Excursion struct {
+	UUID      string   `json:"uuid"`
+	Timestamp uint64   `json:"timestamp"`
+	Seq       uint32   `json:"seq"`
+	Breaches  []Breach `json:"breaches"`
+}
+
+// SetLimits stores limits for scope, which is either a device uuid or
+// "product:<name>".
+func (s *SmartContract) SetLimits(ctx contractapi.TransactionContextInterface,
+	scope string, limitsJson string) error {
+
+	var l Limits
+	if err := json.Unmarshal([]byte(limitsJson), &l); err != nil {
+		return err
+	}
+	for name := range l.Channels {
+		if channelIndex(name) < 0 {
+			return fmt.Errorf("unknown channel %q", name)
+		}
+	}
+	key, err := ctx.GetStub().CreateCompositeKey("limits", []string{scope})
+	if err != nil {
+		return err
+	}
+	b, _ := json.Marshal(&l)
+	return ctx.GetStub().PutState(key, b)
+}
+
+func (s *SmartContract) GetLimits(ctx contractapi.TransactionContextInterface,
+	scope string) (*Limits, error) {
+
+	l, err := readLimits(ctx.GetStub(), scope)
+	if err == nil && l == nil {
+		err = fmt.Errorf("no limits for %s", scope)
+	}
+	return l, err
+}
+
+func channelIndex(name string) int {
+	for i, n := range channelNames {
+		if n == name {
+			return i
+		}
+	}
+	return -1
+}
+
+func readLimits(stub shim.ChaincodeStubInterface, scope string) (*Limits, error) {
+	key, err := stub.CreateCompositeKey("limits", []string{scope})
+	if err != nil {
+		return nil, err
+	}
+	v, err := stub.GetState(key)
+	if err != nil || v == nil {
+		return nil, err
+	}
+	var l Limits
+	if err := json.Unmarshal(v, &l); err != nil {
+		return nil, err
+	}
+	return &l, nil
+}
+
+// limitsCache resolves the limits that apply to a device once per
+// transaction, however many of its readings a batch carries.
+type limitsCache map[string]*Limits
+
+func (c limitsCache) get(stub shim.ChaincodeStubInterface, uuid string) (*Limits, error) {
+	if l, ok := c[uuid]; ok {
+		return l, nil
+	}
+	l, err := readLimits(stub, uuid)
+	if err != nil {
+		return nil, err
+	}
+	if l != nil && len(l.Channels) == 0 && l.Product != "" {
+		if l, err = readLimits(stub, "product:"+l.Product); err != nil {
+			return nil, err
+		}
+	}
+	c[uuid] = l
+	return l, nil
+}
+
+// indexExcursion writes excursion~uuid~ts~seq and excursionts~ts~uuid~seq
+// when r breaches l.
+func indexExcursion(stub shim.ChaincodeStubInterface, r *SensorReading, l *Limits) error {
+	if l == nil || len(l.Channels) == 0 {
+		return nil
+	}
+
+	vals := readingChannels(r)
+	var breaches []Breach
+	for i, name := range channelNames {
+		lim, ok := l.Channels[name]
+		if !ok {
+			continue
+		}
+		v := vals[i]
+		if (lim.Min != nil && v < *lim.Min) || (lim.Max != nil && v > *lim.Max) {
+			breaches = append(breaches, Breach{Channel: name, Value: v, Min: lim.Min, Max: lim.Max})
+		}
+	}
+	if breaches == nil {
+		return nil
+	}
+
+	key, err := stub.CreateCompositeKey("excursion",
+		[]string{r.UUID, tsAttr(r.Timestamp), seqAttr(r.Seq)})
+	if err != nil {
+		return err
+	}
+	byTime, err := stub.CreateCompositeKey("excursionts",
+		[]string{tsAttr(r.Timestamp), r.UUID, seqAttr(r.Seq)})
+	if err != nil {
+		return err
+	}
+	b, _ := json.Marshal(&Excursion{
+		UUID: r.UUID, Timestamp: r.Timestamp, Seq: r.Seq, Breaches: breaches,
+	})
+	if err := stub.PutState(key, b); err != nil {
+		return err
+	}
+	return stub.PutState(byTime, b)
+}
+
+// QueryExcursions returns the breaches of uuid, or of every device when
+// uuid is "all", with from <= timestamp <= to. Only the excursion keys in
+// the window are read: a device's own keys are in time order, and "all"
+// scans excursionts~, which is.
+func (s *SmartContract) QueryExcursions(ctx contractapi.TransactionContextInterface,
+	uuid string, from uint64, to uint64) ([]*Excursion, error) {
+
+	stub := ctx.GetStub()
+	objectType, attrs := "excursion", []string{uuid}
+	start, err := stub.CreateCompositeKey(objectType, []string{uuid, tsAttr(from)})
+	if uuid == "all" {
+		objectType, attrs = "excursionts", nil
+		start, err = stub.CreateCompositeKey(objectType, []string{tsAttr(from)})
+	}
+	if err != nil {
+		return nil, err
+	}
+
+	list := []*Excursion{}
+	err = scanFrom(stub, objectType, attrs, start,
+		func(_ string, value []byte) (bool, error) {
+			var e Excursion
+			if err := json.Unmarshal(value, &e); err != nil {
+				return false, err
+			}
+			if e.Timestamp > to {
+				return false, nil
+			}
+			list = append(list, &e)
+			return true, nil
+		})
+	return list, err
+}
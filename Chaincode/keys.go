@@ -0,0 +1,127 @@
+package main
+
+import (
+	"fmt"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
+	"strconv"
+)
+
+const hexDigits = "0123456789abcdef"
+
+// hexAttr renders v as width zero-padded hex digits.
+func hexAttr(v uint64, width int) string {
+	b := make([]byte, width)
+	for i := width - 1; i >= 0; i-- {
+		b[i] = hexDigits[v&0xf]
+		v >>= 4
+	}
+	return string(b)
+}
+
+// tsAttr renders ts as 16 zero-padded hex digits. Fixed width keeps the
+// lexicographic order of reading keys equal to time order, so a time window
+// is one contiguous range of the key space.
+func tsAttr(ts uint64) string { return hexAttr(ts, 16) }
+
+func seqAttr(seq uint32) string { return hexAttr(uint64(seq), 8) }
+
+func parseTsAttr(attr string) (uint64, error) {
+	if len(attr) != 16 {
+		return 0, fmt.Errorf("bad timestamp key component %q", attr)
+	}
+	return strconv.ParseUint(attr, 16, 64)
+}
+
+// key = reading~uuid~timestamp~seq
+// seq is the device's own sample counter, so together with the gateway
+// timestamp the key is unique by construction and writers never have to
+// look before they put.
+func readingKey(stub shim.ChaincodeStubInterface,
+	uuid string, ts uint64, seq uint32) (string, error) {
+	return stub.CreateCompositeKey("reading", []string{uuid, tsAttr(ts), seqAttr(seq)})
+}
+
+// pendingKey = pending~uuid~timestamp~seq marks a reading CompactDevice has
+// not folded yet and holds a copy of its value. Every write puts it, blind
+// like the reading itself, and compaction deletes it, so the device's
+// pending~ range is exactly its backlog, late arrivals included.
+func pendingKey(stub shim.ChaincodeStubInterface,
+	uuid string, ts uint64, seq uint32) (string, error) {
+	return stub.CreateCompositeKey("pending", []string{uuid, tsAttr(ts), seqAttr(seq)})
+}
+
+// readingPrefix is the partial key shared by every reading of uuid at ts.
+// It sorts before all of them, so it doubles as a range-scan start key.
+func readingPrefix(stub shim.ChaincodeStubInterface, uuid string, ts uint64) (string, error) {
+	return stub.CreateCompositeKey("reading", []string{uuid, tsAttr(ts)})
+}
+
+// scanFrom walks the keys under objectType~attrs in key order, starting at
+// start (a full key, inclusive), one page at a time so no single query hits
+// the peer's result limit. fn returns false to stop early.
+//
+// Paginated queries are only allowed in transactions that do not write: a
+// peer refuses to endorse a PutState or DelState that follows one. Queries
+// use scanFrom; transactions that go on to write use scanForUpdate.
+func scanFrom(stub shim.ChaincodeStubInterface, objectType string, attrs []string,
+	start string, fn func(key string, value []byte) (bool, error)) error {
+
+	for bookmark := start; bookmark != ""; {
+		it, meta, err := stub.GetStateByPartialCompositeKeyWithPagination(
+			objectType, attrs, maxPageSize, bookmark)
+		if err != nil {
+			return err
+		}
+		bookmark = meta.Bookmark
+
+		for it.HasNext() {
+			kv, err := it.Next()
+			if err != nil {
+				it.Close()
+				return err
+			}
+			more, err := fn(kv.Key, kv.Value)
+			if err != nil {
+				it.Close()
+				return err
+			}
+			if !more {
+				it.Close()
+				return nil
+			}
+		}
+		it.Close()
+	}
+	return nil
+}
+
+// scanForUpdate is scanFrom for transactions that write. Without pagination
+// a partial-key query cannot start part way through its range (and
+// GetStateByRange refuses composite keys), so keys before start are stepped
+// over without being decoded. Callers scan ranges that shrink as they work
+// (CompactDevice the pending~ backlog it deletes, PruneDevice the readings
+// it deletes) and bound the rows they take per call through fn.
+func scanForUpdate(stub shim.ChaincodeStubInterface, objectType string, attrs []string,
+	start string, fn func(key string, value []byte) (bool, error)) error {
+
+	it, err := stub.GetStateByPartialCompositeKey(objectType, attrs)
+	if err != nil {
+		return err
+	}
+	defer it.Close()
+
+	for it.HasNext() {
+		kv, err := it.Next()
+		if err != nil {
+			return err
+		}
+		if kv.Key < start {
+			continue
+		}
+		more, err := fn(kv.Key, kv.Value)
+		if err != nil || !more {
+			return err
+		}
+	}
+	return nil
+}
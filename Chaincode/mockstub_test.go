@@ -0,0 +1,341 @@
+package main
+
+import (
+	"errors"
+	"fmt"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
+	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
+	"github.com/hyperledger/fabric-protos-go-apiv2/ledger/queryresult"
+	"github.com/hyperledger/fabric-protos-go-apiv2/peer"
+	"google.golang.org/protobuf/types/known/timestamppb"
+	"sort"
+	"strings"
+	"time"
+	"unicode/utf8"
+)
+
+// An in-memory world state and transaction simulator, close enough to a
+// peer for tests and benchmarks to run the contract offline:
+//
+//   - reads see committed state only, not the transaction's own writes
+//   - composite keys, partial-key scans and pagination behave as on a peer,
+//     with the bookmark being the key the next page starts at; as on a
+//     peer, a transaction that has run a paginated query cannot write
+//   - commit does MVCC validation: a transaction whose read set (point reads
+//     and scanned ranges) changed since it was simulated is invalidated
+//
+// Only the stub methods the contract uses are implemented; anything else
+// panics through the nil embedded interface.
+
+type versionedValue struct {
+	value   []byte
+	version uint64
+}
+
+type memLedger struct {
+	state    map[string]versionedValue
+	sorted   []string // key index; may hold deleted keys
+	unsorted []string // keys added since the index was last sorted
+	height   uint64
+	bytes    int // sum of key and value lengths in state
+	clock    time.Time
+}
+
+func newMemLedger() *memLedger {
+	return &memLedger{
+		state: make(map[string]versionedValue),
+		clock: time.UnixMilli(1717000000000),
+	}
+}
+
+// index returns the sorted key index, folding in keys added since last time.
+func (l *memLedger) index() []string {
+	if len(l.unsorted) > 0 {
+		sort.Strings(l.unsorted)
+		merged := make([]string, 0, len(l.sorted)+len(l.unsorted))
+		i, j := 0, 0
+		for i < len(l.sorted) && j < len(l.unsorted) {
+			if l.sorted[i] < l.unsorted[j] {
+				merged = append(merged, l.sorted[i])
+				i++
+			} else {
+				merged = append(merged, l.unsorted[j])
+				j++
+			}
+		}
+		merged = append(merged, l.sorted[i:]...)
+		l.sorted = append(merged, l.unsorted[j:]...)
+		l.unsorted = l.unsorted[:0]
+	}
+	return l.sorted
+}
+
+// scan returns up to limit live keys in [start, end), limit <= 0 meaning
+// all, and the key after the last one returned ("" if there is none).
+func (l *memLedger) scan(start, end string, limit int) (keys []string, next string) {
+	idx := l.index()
+	for i := sort.SearchStrings(idx, start); i < len(idx); i++ {
+		k := idx[i]
+		if k >= end {
+			break
+		}
+		if _, ok := l.state[k]; !ok || (i > 0 && idx[i-1] == k) {
+			continue
+		}
+		if limit > 0 && len(keys) == limit {
+			return keys, k
+		}
+		keys = append(keys, k)
+	}
+	return keys, ""
+}
+
+func (l *memLedger) put(key string, value []byte) {
+	old, ok := l.state[key]
+	if ok {
+		l.bytes -= len(key) + len(old.value)
+	}
+	if value == nil {
+		delete(l.state, key)
+		return
+	}
+	if !ok {
+		l.unsorted = append(l.unsorted, key)
+	}
+	l.state[key] = versionedValue{value: value, version: l.height}
+	l.bytes += len(key) + len(value)
+}
+
+// newTx starts simulating a transaction against the current state, with a
+// transaction timestamp one millisecond after the previous one.
+func (l *memLedger) newTx() *mockStub {
+	l.clock = l.clock.Add(time.Millisecond)
+	return &mockStub{
+		ledger: l,
+		txID:   fmt.Sprintf("tx%d", l.height),
+		ts:     timestamppb.New(l.clock),
+		reads:  make(map[string]uint64),
+		writes: make(map[string][]byte),
+	}
+}
+
+// commit validates and applies a block of simulated transactions in order,
+// as a peer would, and reports which of them were valid.
+func (l *memLedger) commit(txs ...*mockStub) []bool {
+	l.height++
+	valid := make([]bool, len(txs))
+	for i, tx := range txs {
+		if valid[i] = tx.validate(); !valid[i] {
+			continue
+		}
+		for k, v := range tx.writes {
+			l.put(k, v)
+		}
+	}
+	return valid
+}
+
+type rangeRead struct {
+	start, end string
+	keys       []string // as far as the iterator was read
+	versions   []uint64
+	exhausted  bool // iterator read to the end of the range
+}
+
+type mockStub struct {
+	shim.ChaincodeStubInterface
+
+	ledger *memLedger
+	txID   string
+	ts     *timestamppb.Timestamp
+	reads  map[string]uint64 // key -> version read, 0 if absent
+	ranges []*rangeRead
+	writes map[string][]byte // nil value = delete
+
+	paginated bool // ran a paginated query, so it may not write
+
+	// the transaction's chaincode event; as on a peer, the last one set wins
+	eventName    string
+	eventPayload []byte
+}
+
+func (s *mockStub) ctx() contractapi.TransactionContextInterface {
+	ctx := &contractapi.TransactionContext{}
+	ctx.SetStub(s)
+	return ctx
+}
+
+func (s *mockStub) validate() bool {
+	for k, ver := range s.reads {
+		if s.ledger.state[k].version != ver {
+			return false
+		}
+	}
+	for _, r := range s.ranges {
+		// As on a peer: re-run the range up to where the iterator got and
+		// compare; if it ran to the end, anything new in the range counts.
+		limit := len(r.keys)
+		if r.exhausted {
+			limit = 0
+		} else if limit == 0 {
+			continue
+		}
+		keys, _ := s.ledger.scan(r.start, r.end, limit)
+		if len(keys) != len(r.keys) {
+			return false
+		}
+		for i, k := range r.keys {
+			if keys[i] != k || s.ledger.state[k].version != r.versions[i] {
+				return false
+			}
+		}
+	}
+	return true
+}
+
+func (s *mockStub) GetTxID() string      { return s.txID }
+func (s *mockStub) GetChannelID() string { return "mychannel" }
+
+func (s *mockStub) GetTxTimestamp() (*timestamppb.Timestamp, error) { return s.ts, nil }
+
+func (s *mockStub) GetState(key string) ([]byte, error) {
+	v, ok := s.ledger.state[key]
+	if ok {
+		s.reads[key] = v.version
+	} else {
+		s.reads[key] = 0
+	}
+	return v.value, nil
+}
+
+// errPaginatedWrite is what a peer answers to a write after a paginated
+// query: those are only allowed in transactions that just read.
+var errPaginatedWrite = errors.New("transaction has already performed a paginated query. Writes are not allowed")
+
+func (s *mockStub) PutState(key string, value []byte) error {
+	if key == "" {
+		return errors.New("key must not be an empty string")
+	}
+	if s.paginated {
+		return errPaginatedWrite
+	}
+	if value == nil {
+		value = []byte{}
+	}
+	s.writes[key] = value
+	return nil
+}
+
+func (s *mockStub) DelState(key string) error {
+	if s.paginated {
+		return errPaginatedWrite
+	}
+	s.writes[key] = nil
+	return nil
+}
+
+func (s *mockStub) SetEvent(name string, payload []byte) error {
+	if name == "" {
+		return errors.New("event name can not be empty string")
+	}
+	s.eventName, s.eventPayload = name, payload
+	return nil
+}
+
+func (s *mockStub) CreateCompositeKey(objectType string, attributes []string) (string, error) {
+	return shim.CreateCompositeKey(objectType, attributes)
+}
+
+func (s *mockStub) SplitCompositeKey(compositeKey string) (string, []string, error) {
+	parts := strings.Split(compositeKey, "\x00")
+	if len(parts) < 3 || parts[0] != "" || parts[len(parts)-1] != "" {
+		return "", nil, fmt.Errorf("invalid composite key %q", compositeKey)
+	}
+	return parts[1], parts[2 : len(parts)-1], nil
+}
+
+func (s *mockStub) GetStateByRange(startKey, endKey string) (shim.StateQueryIteratorInterface, error) {
+	it, _, err := s.rangeQuery(startKey, endKey, 0, "", false)
+	return it, err
+}
+
+func (s *mockStub) GetStateByRangeWithPagination(startKey, endKey string, pageSize int32,
+	bookmark string) (shim.StateQueryIteratorInterface, *peer.QueryResponseMetadata, error) {
+	s.paginated = true
+	return s.rangeQuery(startKey, endKey, pageSize, bookmark, false)
+}
+
+func (s *mockStub) GetStateByPartialCompositeKey(objectType string,
+	keys []string) (shim.StateQueryIteratorInterface, error) {
+
+	start, err := shim.CreateCompositeKey(objectType, keys)
+	if err != nil {
+		return nil, err
+	}
+	it, _, err := s.rangeQuery(start, start+string(utf8.MaxRune), 0, "", true)
+	return it, err
+}
+
+func (s *mockStub) GetStateByPartialCompositeKeyWithPagination(objectType string, keys []string,
+	pageSize int32, bookmark string) (shim.StateQueryIteratorInterface, *peer.QueryResponseMetadata, error) {
+
+	s.paginated = true
+	start, err := shim.CreateCompositeKey(objectType, keys)
+	if err != nil {
+		return nil, nil, err
+	}
+	return s.rangeQuery(start, start+string(utf8.MaxRune), pageSize, bookmark, true)
+}
+
+func (s *mockStub) rangeQuery(start, end string, pageSize int32, bookmark string,
+	composite bool) (shim.StateQueryIteratorInterface, *peer.QueryResponseMetadata, error) {
+
+	if !composite && (strings.HasPrefix(start, "\x00") || strings.HasPrefix(end, "\x00")) {
+		return nil, nil, errors.New("range queries do not accept composite keys")
+	}
+	if end == "" {
+		end = string(utf8.MaxRune) // open ended
+	}
+	if bookmark != "" && bookmark > start {
+		start = bookmark
+	}
+	keys, next := s.ledger.scan(start, end, int(pageSize))
+
+	rr := &rangeRead{start: start, end: end, exhausted: len(keys) == 0 && next == ""}
+	s.ranges = append(s.ranges, rr)
+	it := &memIterator{
+		kvs:  make([]*queryresult.KV, len(keys)),
+		vers: make([]uint64, len(keys)),
+		read: rr,
+		last: next == "",
+	}
+	for i, k := range keys {
+		v := s.ledger.state[k]
+		it.kvs[i] = &queryresult.KV{Key: k, Value: v.value}
+		it.vers[i] = v.version
+	}
+	return it, &peer.QueryResponseMetadata{FetchedRecordsCount: int32(len(keys)), Bookmark: next}, nil
+}
+
+type memIterator struct {
+	kvs  []*queryresult.KV
+	vers []uint64
+	i    int
+	read *rangeRead
+	last bool // no page after this one
+}
+
+func (it *memIterator) HasNext() bool { return it.i < len(it.kvs) }
+func (it *memIterator) Close() error  { return nil }
+
+func (it *memIterator) Next() (*queryresult.KV, error) {
+	if it.i >= len(it.kvs) {
+		return nil, errors.New("no more results")
+	}
+	kv := it.kvs[it.i]
+	it.read.keys = append(it.read.keys, kv.Key)
+	it.read.versions = append(it.read.versions, it.vers[it.i])
+	it.i++
+	it.read.exhausted = it.last && it.i == len(it.kvs)
+	return kv, nil
+}
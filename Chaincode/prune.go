@@ -0,0 +1,221 @@
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
+	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
+	"strings"
+)
+
+// Retention of raw readings, configured per device class:
+//
+//	retention~class -> Retention
+//
+// A device's class is set in its registry entry with SetDeviceClass;
+// devices without one use the "default" class. PruneDevice only ever
+// deletes readings that are older than the class allows and, unless the
+// class says otherwise, already summarised by CompactDevice, so rollups and
+// shipment figures survive the raw data. A reading still queued under
+// pending~ is kept, whatever its timestamp: one that committed late is not
+// deleted before it is folded. Excursion keys are the compliance record and
+// are never pruned.
+
+type Retention struct {
+	KeepMs        uint64 `json:"keep_ms"`        // raw readings younger than this are kept
+	RequireRollup bool   `json:"require_rollup"` // only prune what CompactDevice has folded
+}
+
+type PruneResult struct {
+	Deleted  int    `json:"deleted"`
+	Kept     int    `json:"kept"` // expired, but not folded by CompactDevice yet
+	Cutoff   uint64 `json:"cutoff"`
+	Bookmark string `json:"bookmark"` // reading key the next call starts at
+	More     bool   `json:"more"`
+}
+
+func (s *SmartContract) SetRetention(ctx contractapi.TransactionContextInterface,
+	class string, retentionJson string) error {
+
+	var r Retention
+	if err := json.Unmarshal([]byte(retentionJson), &r); err != nil {
+		return err
+	}
+	key, err := ctx.GetStub().CreateCompositeKey("retention", []string{class})
+	if err != nil {
+		return err
+	}
+	b, _ := json.Marshal(&r)
+	return ctx.GetStub().PutState(key, b)
+}
+
+func (s *SmartContract) SetDeviceClass(ctx contractapi.TransactionContextInterface,
+	uuid string, class string) error {
+
+	stub := ctx.GetStub()
+	key, err := stub.CreateCompositeKey("device", []string{uuid})
+	if err != nil {
+		return err
+	}
+	v, err := stub.GetState(key)
+	if err != nil {
+		return err
+	}
+	if v == nil {
+		return fmt.Errorf("device %s not registered", uuid)
+	}
+	var d Device
+	if err := json.Unmarshal(v, &d); err != nil {
+		return err
+	}
+	d.Class = class
+	b, _ := json.Marshal(&d)
+	return stub.PutState(key, b)
+}
+
+// PruneDevice deletes raw readings of uuid stamped before `before`, within
+// what the device class's retention allows, looking at no more than maxKeys
+// readings per call. Start with an empty bookmark and call it again with
+// the returned one while More is set; each call is one bounded transaction.
+func (s *SmartContract) PruneDevice(ctx contractapi.TransactionContextInterface,
+	uuid string, before uint64, maxKeys int32, bookmark string) (*PruneResult, error) {
+
+	stub := ctx.GetStub()
+	maxKeys = clampPageSize(maxKeys)
+
+	class := "default"
+	devKey, _ := stub.CreateCompositeKey("device", []string{uuid})
+	if v, err := stub.GetState(devKey); err != nil {
+		return nil, err
+	} else if v != nil {
+		var d Device
+		if err := json.Unmarshal(v, &d); err != nil {
+			return nil, err
+		}
+		if d.Class != "" {
+			class = d.Class
+		}
+	}
+
+	retKey, _ := stub.CreateCompositeKey("retention", []string{class})
+	pol := Retention{RequireRollup: true}
+	if v, err := stub.GetState(retKey); err != nil {
+		return nil, err
+	} else if v != nil {
+		if err := json.Unmarshal(v, &pol); err != nil {
+			return nil, err
+		}
+	}
+
+	cutoff := before
+	now, err := txTimeMs(stub)
+	if err != nil {
+		return nil, err
+	}
+	if pol.KeepMs > now {
+		cutoff = 0
+	} else if c := now - pol.KeepMs; c < cutoff {
+		cutoff = c
+	}
+	res := &PruneResult{Cutoff: cutoff}
+	if cutoff == 0 {
+		return res, nil
+	}
+	end, err := readingPrefix(stub, uuid, cutoff)
+	if err != nil {
+		return nil, err
+	}
+	if bookmark == "" {
+		if bookmark, err = readingPrefix(stub, uuid, 0); err != nil {
+			return nil, err
+		}
+	}
+
+	var pending *pendingCursor
+	if pol.RequireRollup {
+		if pending, err = newPendingCursor(stub, uuid); err != nil {
+			return nil, err
+		}
+		defer pending.close()
+	}
+
+	// Not paginated: this transaction deletes, which a peer does not allow
+	// after a paginated query.
+	seen := 0
+	err = scanForUpdate(stub, "reading", []string{uuid}, bookmark,
+		func(key string, _ []byte) (bool, error) {
+			if key >= end {
+				return false, nil
+			}
+			if seen == int(maxKeys) {
+				res.Bookmark, res.More = key, true
+				return false, nil
+			}
+			seen++
+			if pending != nil {
+				queued, err := pending.has(key)
+				if err != nil {
+					return false, err
+				}
+				if queued {
+					res.Kept++
+					return true, nil
+				}
+			}
+			if err := stub.DelState(key); err != nil {
+				return false, err
+			}
+			res.Deleted++
+			return true, nil
+		})
+	if err != nil {
+		return nil, err
+	}
+	return res, nil
+}
+
+// pendingCursor walks a device's pending~ keys alongside its reading~ keys.
+// The two keys of one reading differ only in the object type and both sort
+// by (timestamp, seq), so one pass over each answers, for readings asked
+// about in key order, which are still pending.
+type pendingCursor struct {
+	it      shim.StateQueryIteratorInterface
+	reading string // "\x00reading\x00", the prefix of every reading key
+	pending string // likewise for pending keys
+	head    string // the last pending key read, with reading's prefix
+	done    bool
+}
+
+func newPendingCursor(stub shim.ChaincodeStubInterface, uuid string) (*pendingCursor, error) {
+	reading, err := stub.CreateCompositeKey("reading", nil)
+	if err != nil {
+		return nil, err
+	}
+	pending, err := stub.CreateCompositeKey("pending", nil)
+	if err != nil {
+		return nil, err
+	}
+	it, err := stub.GetStateByPartialCompositeKey("pending", []string{uuid})
+	if err != nil {
+		return nil, err
+	}
+	return &pendingCursor{it: it, reading: reading, pending: pending}, nil
+}
+
+// has reports whether the reading stored under key is still pending.
+func (p *pendingCursor) has(key string) (bool, error) {
+	for !p.done && p.head < key {
+		if !p.it.HasNext() {
+			p.done = true
+			break
+		}
+		kv, err := p.it.Next()
+		if err != nil {
+			return false, err
+		}
+		p.head = p.reading + strings.TrimPrefix(kv.Key, p.pending)
+	}
+	return p.head == key, nil
+}
+
+func (p *pendingCursor) close() { p.it.Close() }
@@ -0,0 +1,104 @@
+package main
+
+import (
+	"encoding/json"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
+	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
+)
+
+// Device registry:
+//
+//	device~uuid -> Device, created by the device's first reading
+//
+// The record is written once and then left alone, so the write path can
+// check for it without the key ever becoming a source of MVCC conflicts.
+// The figures that change with every reading are taken from where they are
+// already maintained: last seen and last sequence from latest~uuid, the
+// compacted count from the compact~uuid cursor. ListDevices joins the three
+// for one bounded page. Neither is exact: latest~uuid is last writer wins
+// (see putLatest), and the cursor counts only what CompactDevice has
+// folded, not the readings still pending.
+
+type Device struct {
+	UUID      string `json:"uuid"`
+	Class     string `json:"class,omitempty"`
+	FirstSeen uint64 `json:"first_seen"`
+}
+
+type DeviceInfo struct {
+	Device
+	LastSeen  uint64 `json:"last_seen"` // of the reading in latest~uuid
+	LastSeq   uint32 `json:"last_seq"`
+	Compacted uint64 `json:"compacted"` // readings folded by CompactDevice so far
+}
+
+type DevicePage struct {
+	Devices  []*DeviceInfo `json:"devices"`
+	Bookmark string        `json:"bookmark"`
+}
+
+// registerDevice creates device~uuid if this is the device's first reading.
+func registerDevice(stub shim.ChaincodeStubInterface, uuid string, ts uint64) error {
+	key, err := stub.CreateCompositeKey("device", []string{uuid})
+	if err != nil {
+		return err
+	}
+	v, err := stub.GetState(key)
+	if err != nil || v != nil {
+		return err
+	}
+	b, _ := json.Marshal(&Device{UUID: uuid, FirstSeen: ts})
+	return stub.PutState(key, b)
+}
+
+// ListDevices returns one page of the registry, pageSize devices at most.
+// Pass the returned bookmark back for the next page; it is empty after the
+// last one.
+func (s *SmartContract) ListDevices(ctx contractapi.TransactionContextInterface,
+	pageSize int32, bookmark string) (*DevicePage, error) {
+
+	stub := ctx.GetStub()
+	it, meta, err := stub.GetStateByPartialCompositeKeyWithPagination(
+		"device", nil, clampPageSize(pageSize), bookmark)
+	if err != nil {
+		return nil, err
+	}
+	defer it.Close()
+
+	page := &DevicePage{Devices: []*DeviceInfo{}, Bookmark: meta.Bookmark}
+	for it.HasNext() {
+		kv, err := it.Next()
+		if err != nil {
+			return nil, err
+		}
+		info := &DeviceInfo{}
+		if err := json.Unmarshal(kv.Value, &info.Device); err != nil {
+			return nil, err
+		}
+
+		latestKey, _ := stub.CreateCompositeKey("latest", []string{info.UUID})
+		if v, err := stub.GetState(latestKey); err != nil {
+			return nil, err
+		} else if v != nil {
+			var r SensorReading
+			if err := decodeReading(v, &r); err != nil {
+				return nil, err
+			}
+			info.LastSeen, info.LastSeq = r.Timestamp, r.Seq
+		}
+
+		cursorKey, _ := stub.CreateCompositeKey("compact", []string{info.UUID})
+		if v, err := stub.GetState(cursorKey); err != nil {
+			return nil, err
+		} else if v != nil {
+			var cur compactCursor
+			if err := json.Unmarshal(v, &cur); err != nil {
+				return nil, err
+			}
+			info.Compacted = cur.Count
+		}
+
+		page.Devices = append(page.Devices, info)
+	}
+	return page, nil
+}
@@ -0,0 +1,287 @@
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
+	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
+)
+
+// Rollups are per device, per resolution, per time bucket summaries:
+//
+//	rollup~uuid~resolution~bucketStart -> Rollup
+//	compact~uuid                       -> compactCursor
+//
+// They are not touched by CreateReading. Updating them on every write would
+// turn each bucket into a hot key that every concurrent write for the device
+// reads and rewrites, which is exactly the MVCC conflict the blind write
+// path avoids. Instead every write queues its reading under pending~ (see
+// keys.go) and CompactDevice folds that backlog into the buckets (and into
+// the shipment accumulators, see shipment.go) in a separate transaction,
+// deleting what it folded. A run costs what is pending, not the device's
+// history, and a reading that commits late, behind readings already folded,
+// is still queued and folded into its bucket. A reading submitted again
+// after it was folded (a replay that lands after compaction) is queued
+// again and counted twice.
+
+var resolutions = []struct {
+	Name  string
+	Width uint64 // ms
+}{
+	{"hour", 3600 * 1000},
+	{"day", 24 * 3600 * 1000},
+}
+
+// Readings younger than this are left for the next compaction, so the ones
+// committed slightly out of timestamp order are still folded in order.
+const compactLagMs = 60 * 1000
+
+// channel order used by readingChannels
+var channelNames = []string{
+	"pressure", "humidity", "temperature", "tvoc",
+	"r", "g", "b", "accel_x", "accel_y", "accel_z",
+}
+
+func readingChannels(r *SensorReading) []float64 {
+	return []float64{
+		r.Pressure, r.Humidity, r.Temperature, float64(r.TVOC),
+		float64(r.R), float64(r.G), float64(r.B),
+		float64(r.AccelX), float64(r.AccelY), float64(r.AccelZ),
+	}
+}
+
+type ChannelStats struct {
+	Min   float64 `json:"min"`
+	Max   float64 `json:"max"`
+	Sum   float64 `json:"sum"`
+	First float64 `json:"first"`
+	Last  float64 `json:"last"`
+}
+
+type Rollup struct {
+	UUID       string                   `json:"uuid"`
+	Resolution string                   `json:"resolution"`
+	Start      uint64                   `json:"start"`
+	Count      uint64                   `json:"count"`
+	FirstTs    uint64                   `json:"first_ts"`
+	LastTs     uint64                   `json:"last_ts"`
+	Channels   map[string]*ChannelStats `json:"channels"`
+}
+
+// add folds one reading in. Readings may come in any order: First and Last
+// follow the timestamps, not the order of the calls.
+func (ru *Rollup) add(r *SensorReading) {
+	vals := readingChannels(r)
+	if ru.Count == 0 {
+		ru.FirstTs, ru.LastTs = r.Timestamp, r.Timestamp
+		ru.Channels = make(map[string]*ChannelStats, len(channelNames))
+		for i, name := range channelNames {
+			v := vals[i]
+			ru.Channels[name] = &ChannelStats{Min: v, Max: v, First: v, Last: v}
+		}
+	}
+	first, last := r.Timestamp < ru.FirstTs, r.Timestamp >= ru.LastTs
+	for i, name := range channelNames {
+		c, v := ru.Channels[name], vals[i]
+		if v < c.Min {
+			c.Min = v
+		}
+		if v > c.Max {
+			c.Max = v
+		}
+		c.Sum += v
+		if first {
+			c.First = v
+		}
+		if last {
+			c.Last = v
+		}
+	}
+	ru.Count++
+	if first {
+		ru.FirstTs = r.Timestamp
+	}
+	if last {
+		ru.LastTs = r.Timestamp
+	}
+}
+
+type compactCursor struct {
+	LastTs uint64 `json:"last_ts"` // newest reading folded so far
+	Count  uint64 `json:"count"`   // readings folded so far
+}
+
+// CompactResult tells the caller how far CompactDevice got. More is set
+// when maxKeys ran out before the compaction horizon was reached.
+type CompactResult struct {
+	Folded int    `json:"folded"`
+	LastTs uint64 `json:"last_ts"`
+	More   bool   `json:"more"`
+}
+
+func txTimeMs(stub shim.ChaincodeStubInterface) (uint64, error) {
+	t, err := stub.GetTxTimestamp()
+	if err != nil {
+		return 0, err
+	}
+	return uint64(t.GetSeconds())*1000 + uint64(t.GetNanos())/1e6, nil
+}
+
+func rollupKey(stub shim.ChaincodeStubInterface, uuid, res string, start uint64) (string, error) {
+	return stub.CreateCompositeKey("rollup", []string{uuid, res, tsAttr(start)})
+}
+
+// CompactDevice folds at most maxKeys pending readings of uuid into its
+// rollups, oldest first, and takes them off pending~. Call it again while
+// More is set.
+func (s *SmartContract) CompactDevice(ctx contractapi.TransactionContextInterface,
+	uuid string, maxKeys int32) (*CompactResult, error) {
+
+	stub := ctx.GetStub()
+	if maxKeys <= 0 || maxKeys > maxPageSize {
+		maxKeys = maxPageSize
+	}
+
+	now, err := txTimeMs(stub)
+	if err != nil {
+		return nil, err
+	}
+	horizon := now - compactLagMs
+
+	cursorKey, _ := stub.CreateCompositeKey("compact", []string{uuid})
+	var cur compactCursor
+	if v, err := stub.GetState(cursorKey); err != nil {
+		return nil, err
+	} else if v != nil {
+		if err := json.Unmarshal(v, &cur); err != nil {
+			return nil, err
+		}
+	}
+
+	ship, err := loadShipment(stub, uuid, limitsCache{})
+	if err != nil {
+		return nil, err
+	}
+
+	touched := make(map[string]*Rollup)
+	var order []string // keeps PutState order deterministic across peers
+	res := &CompactResult{LastTs: cur.LastTs}
+
+	err = scanForUpdate(stub, "pending", []string{uuid}, "",
+		func(key string, value []byte) (bool, error) {
+			if res.Folded >= int(maxKeys) {
+				res.More = true
+				return false, nil
+			}
+			var r SensorReading
+			if err := decodeReading(value, &r); err != nil {
+				return false, err
+			}
+			if r.Timestamp >= horizon {
+				return false, nil
+			}
+
+			for _, rs := range resolutions {
+				bucket := r.Timestamp - r.Timestamp%rs.Width
+				rk, err := rollupKey(stub, uuid, rs.Name, bucket)
+				if err != nil {
+					return false, err
+				}
+				ru, ok := touched[rk]
+				if !ok {
+					if ru, err = loadRollup(stub, rk); err != nil {
+						return false, err
+					}
+					if ru == nil {
+						ru = &Rollup{UUID: uuid, Resolution: rs.Name, Start: bucket}
+					}
+					touched[rk] = ru
+					order = append(order, rk)
+				}
+				ru.add(&r)
+			}
+			ship.add(&r)
+			if err := stub.DelState(key); err != nil {
+				return false, err
+			}
+
+			if r.Timestamp > cur.LastTs {
+				cur.LastTs = r.Timestamp
+			}
+			cur.Count++
+			res.Folded++
+			res.LastTs = cur.LastTs
+			return true, nil
+		})
+	if err != nil {
+		return nil, err
+	}
+	if res.Folded == 0 {
+		return res, nil
+	}
+
+	for _, rk := range order {
+		b, err := json.Marshal(touched[rk])
+		if err != nil {
+			return nil, err
+		}
+		if err := stub.PutState(rk, b); err != nil {
+			return nil, err
+		}
+	}
+	if err := putShipment(stub, ship); err != nil {
+		return nil, err
+	}
+	b, _ := json.Marshal(&cur)
+	return res, stub.PutState(cursorKey, b)
+}
+
+func loadRollup(stub shim.ChaincodeStubInterface, key string) (*Rollup, error) {
+	v, err := stub.GetState(key)
+	if err != nil || v == nil {
+		return nil, err
+	}
+	var ru Rollup
+	if err := json.Unmarshal(v, &ru); err != nil {
+		return nil, err
+	}
+	return &ru, nil
+}
+
+// QueryRollups returns the resolution buckets of uuid overlapping
+// [from, to]. A month of hourly data is ~720 keys however many raw
+// readings it summarises.
+func (s *SmartContract) QueryRollups(ctx contractapi.TransactionContextInterface,
+	uuid string, resolution string, from uint64, to uint64) ([]*Rollup, error) {
+
+	var width uint64
+	for _, rs := range resolutions {
+		if rs.Name == resolution {
+			width = rs.Width
+		}
+	}
+	if width == 0 {
+		return nil, fmt.Errorf("unknown resolution %q", resolution)
+	}
+
+	stub := ctx.GetStub()
+	start, err := rollupKey(stub, uuid, resolution, from-from%width)
+	if err != nil {
+		return nil, err
+	}
+
+	list := []*Rollup{}
+	err = scanFrom(stub, "rollup", []string{uuid, resolution}, start,
+		func(_ string, value []byte) (bool, error) {
+			var ru Rollup
+			if err := json.Unmarshal(value, &ru); err != nil {
+				return false, err
+			}
+			if ru.Start > to {
+				return false, nil
+			}
+			list = append(list, &ru)
+			return true, nil
+		})
+	return list, err
+}
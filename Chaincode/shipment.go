@@ -0,0 +1,218 @@
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"github.com/hyperledger/fabric-chaincode-go/v2/shim"
+	"github.com/hyperledger/fabric-contract-api-go/v2/contractapi"
+	"math"
+)
+
+// Cold-chain compliance figures per device, kept as O(1) accumulators:
+//
+//	shipment~uuid -> ShipmentStatus
+//
+// They are folded in by CompactDevice alongside the rollups, so the write
+// path stays blind. The stored figures lag the ledger by the compaction
+// interval (and compactLagMs); GetShipmentStatus closes the gap on read by
+// folding in the device's pending~ readings, at most one page of them, so
+// its cost stays bounded however long the shipment has run.
+//
+// Mean kinetic temperature is time weighted: each reading's temperature
+// holds until the next reading, up to maxHoldMs (longer gaps count as no
+// data). With k = ΔH/R,
+//
+//	MKT = k / (k/Tref - ln(Σ w·exp(-k(1/T - 1/Tref)) / Σ w))
+//
+// Tref only keeps the exponentials near 1; it cancels out.
+
+const (
+	mktK      = 10000.0 // ΔH/R in kelvin, for ΔH = 83.144 kJ/mol (USP <1079.2>)
+	mktTref   = 298.15
+	maxHoldMs = 15 * 60 * 1000
+
+	defaultLowC  = 2.0
+	defaultHighC = 8.0
+)
+
+type ShipmentStatus struct {
+	UUID       string  `json:"uuid"`
+	Since      uint64  `json:"since"`
+	Count      uint64  `json:"count"`
+	LastTs     uint64  `json:"last_ts"`
+	LastTemp   float64 `json:"last_temp"`
+	MinTemp    float64 `json:"min_temp"`
+	MaxTemp    float64 `json:"max_temp"`
+	LowC       float64 `json:"low_c"`
+	HighC      float64 `json:"high_c"`
+	CoveredMs  uint64  `json:"covered_ms"`
+	AboveMs    uint64  `json:"above_ms"`
+	BelowMs    uint64  `json:"below_ms"`
+	ArrhSum    float64 `json:"arrh_sum"` // Σ w·exp(-k(1/T - 1/Tref)), w in ms
+	MKT        float64 `json:"mkt"`      // derived on read, °C
+	MinutesOut float64 `json:"minutes_out_of_range"`
+	Pending    int     `json:"pending"` // readings not compacted yet, folded in on read
+	Partial    bool    `json:"partial"` // more than a page pending: figures stop short
+}
+
+// add folds one reading in. The interval since the previous reading is
+// charged to the previous temperature. A reading older than the last one
+// folded (it committed late) counts toward min, max and count only: the
+// interval it falls in has been charged already.
+func (st *ShipmentStatus) add(r *SensorReading) {
+	if r.Timestamp < st.Since {
+		return // before the last ResetShipment
+	}
+	t := r.Temperature
+	if st.Count > 0 && r.Timestamp < st.LastTs {
+		st.MinTemp = math.Min(st.MinTemp, t)
+		st.MaxTemp = math.Max(st.MaxTemp, t)
+		st.Count++
+		return
+	}
+	if st.Count > 0 && r.Timestamp > st.LastTs {
+		dt := r.Timestamp - st.LastTs
+		if dt > maxHoldMs {
+			dt = maxHoldMs
+		}
+		tk := st.LastTemp + 273.15
+		st.ArrhSum += float64(dt) * math.Exp(-mktK*(1/tk-1/mktTref))
+		st.CoveredMs += dt
+		if st.LastTemp > st.HighC {
+			st.AboveMs += dt
+		} else if st.LastTemp < st.LowC {
+			st.BelowMs += dt
+		}
+	}
+	if st.Count == 0 || t < st.MinTemp {
+		st.MinTemp = t
+	}
+	if st.Count == 0 || t > st.MaxTemp {
+		st.MaxTemp = t
+	}
+	st.Count++
+	st.LastTs = r.Timestamp
+	st.LastTemp = t
+}
+
+func (st *ShipmentStatus) derive() {
+	st.MKT = 0
+	if st.CoveredMs > 0 {
+		st.MKT = mktK/(mktK/mktTref-math.Log(st.ArrhSum/float64(st.CoveredMs))) - 273.15
+	} else if st.Count > 0 {
+		st.MKT = st.LastTemp
+	}
+	st.MinutesOut = float64(st.AboveMs+st.BelowMs) / 60000
+}
+
+func shipmentKey(stub shim.ChaincodeStubInterface, uuid string) (string, error) {
+	return stub.CreateCompositeKey("shipment", []string{uuid})
+}
+
+// loadShipment returns the device's accumulator, or a fresh one if it has
+// none yet.
+func loadShipment(stub shim.ChaincodeStubInterface, uuid string,
+	limits limitsCache) (*ShipmentStatus, error) {
+
+	key, err := shipmentKey(stub, uuid)
+	if err != nil {
+		return nil, err
+	}
+	v, err := stub.GetState(key)
+	if err != nil {
+		return nil, err
+	}
+	if v == nil {
+		return newShipment(stub, uuid, limits)
+	}
+	var st ShipmentStatus
+	return &st, json.Unmarshal(v, &st)
+}
+
+// newShipment starts an accumulator with the device's temperature limits,
+// or 2–8 °C if none are set.
+func newShipment(stub shim.ChaincodeStubInterface, uuid string,
+	limits limitsCache) (*ShipmentStatus, error) {
+
+	st := &ShipmentStatus{UUID: uuid, LowC: defaultLowC, HighC: defaultHighC}
+	l, err := limits.get(stub, uuid)
+	if err != nil {
+		return nil, err
+	}
+	if l != nil {
+		if rg, ok := l.Channels["temperature"]; ok {
+			if rg.Min != nil {
+				st.LowC = *rg.Min
+			}
+			if rg.Max != nil {
+				st.HighC = *rg.Max
+			}
+		}
+	}
+	return st, nil
+}
+
+func putShipment(stub shim.ChaincodeStubInterface, st *ShipmentStatus) error {
+	key, err := shipmentKey(stub, st.UUID)
+	if err != nil {
+		return err
+	}
+	b, _ := json.Marshal(st)
+	return stub.PutState(key, b)
+}
+
+// GetShipmentStatus returns MKT and time out of range for uuid: the stored
+// accumulators plus the readings CompactDevice has not folded yet. It only
+// reads, so it walks them with a paginated scan.
+func (s *SmartContract) GetShipmentStatus(ctx contractapi.TransactionContextInterface,
+	uuid string) (*ShipmentStatus, error) {
+
+	stub := ctx.GetStub()
+	st, err := loadShipment(stub, uuid, limitsCache{})
+	if err != nil {
+		return nil, err
+	}
+
+	start, err := stub.CreateCompositeKey("pending", []string{uuid})
+	if err != nil {
+		return nil, err
+	}
+	err = scanFrom(stub, "pending", []string{uuid}, start,
+		func(_ string, value []byte) (bool, error) {
+			if st.Pending == maxPageSize {
+				st.Partial = true
+				return false, nil
+			}
+			var r SensorReading
+			if err := decodeReading(value, &r); err != nil {
+				return false, err
+			}
+			st.add(&r)
+			st.Pending++
+			return true, nil
+		})
+	if err != nil {
+		return nil, err
+	}
+	if st.Count == 0 {
+		return nil, fmt.Errorf("no shipment status for %s", uuid)
+	}
+	st.derive()
+	return st, nil
+}
+
+// ResetShipment starts a new shipment for uuid: accumulators restart with
+// the device's current limits and only count readings from now on.
+func (s *SmartContract) ResetShipment(ctx contractapi.TransactionContextInterface,
+	uuid string) error {
+
+	stub := ctx.GetStub()
+	st, err := newShipment(stub, uuid, limitsCache{})
+	if err != nil {
+		return err
+	}
+	if st.Since, err = txTimeMs(stub); err != nil {
+		return err
+	}
+	return putShipment(stub, st)
+}
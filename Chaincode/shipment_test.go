@@ -0,0 +1,59 @@
+package main
+
+import (
+	"math"
+	"testing"
+)
+
+func TestShipmentMKT(t *testing.T) {
+	st := &ShipmentStatus{LowC: defaultLowC, HighC: defaultHighC}
+	for i, temp := range []float64{5, 5, 5, 5} {
+		st.add(&SensorReading{Timestamp: uint64(i) * 60000, Temperature: temp})
+	}
+	st.derive()
+	if math.Abs(st.MKT-5) > 1e-9 || st.MinutesOut != 0 {
+		t.Fatalf("constant 5 °C: MKT %v, out %v min", st.MKT, st.MinutesOut)
+	}
+
+	// 10 min at 4 °C then 10 min at 12 °C: MKT sits above the arithmetic
+	// mean of 8 °C and the second half is out of range.
+	st = &ShipmentStatus{LowC: defaultLowC, HighC: defaultHighC}
+	st.add(&SensorReading{Timestamp: 0, Temperature: 4})
+	st.add(&SensorReading{Timestamp: 600000, Temperature: 12})
+	st.add(&SensorReading{Timestamp: 1200000, Temperature: 12})
+	st.derive()
+	if st.MKT <= 8 || st.MKT >= 12 || st.MinutesOut != 10 {
+		t.Fatalf("step: MKT %v, out %v min", st.MKT, st.MinutesOut)
+	}
+}
+
+func TestShipmentStatusIncludesUncompacted(t *testing.T) {
+	l := newMemLedger()
+	seedReadings(t, l, 100)
+	c := &SmartContract{}
+	l.clock = l.clock.Add(24 * 3600 * 1000 * 1e6)
+
+	// Nothing compacted yet: every reading is folded in on read.
+	st, err := c.GetShipmentStatus(l.newTx().ctx(), "AB12")
+	if err != nil {
+		t.Fatal(err)
+	}
+	if st.Count != 100 || st.Pending != 100 || math.Abs(st.MKT-5) > 1e-9 {
+		t.Fatalf("before compaction: %+v", st)
+	}
+
+	tx := l.newTx()
+	if _, err := c.CompactDevice(tx.ctx(), "AB12", 40); err != nil {
+		t.Fatal(err)
+	}
+	l.commit(tx)
+
+	// Part compacted: the same figures, 40 of them from the accumulators.
+	after, err := c.GetShipmentStatus(l.newTx().ctx(), "AB12")
+	if err != nil {
+		t.Fatal(err)
+	}
+	if after.Count != 100 || after.Pending != 60 || after.CoveredMs != st.CoveredMs {
+		t.Fatalf("after compaction: %+v", after)
+	}
+}
@@ -15,6 +15,10 @@ const signer = signers.newPrivateKeySigner(
     crypto.createPrivateKey(keyPem));
 
 const peerEndpoint = 'peer0.org1.example.com:7051';
+const HISTORY_WINDOW_MS = 10 * 60 * 1000;
+// The gateway's live stream; see Gateway/stream.js.
+const STREAM_URL = process.env.GATEWAY_STREAM || 'ws://192.168.0.49:3000/stream';
+const utf8 = new TextDecoder();
 
 const dropdown = document.getElementById('dynamic-dropdown');
 const refresh = document.getElementById('refresh');
@@ -22,25 +26,29 @@ const refresh = document.getElementById('refresh');
 dropdown.addEventListener('change', (event) => {
 
     dataPoints = [];
-    const selectedValues = Array.from(dropdown.selectedOptions)
-        .map(option => option.value);
-    // console.log(selectedValues);
-    selectedValues.forEach(uuid => {
-        // console.log(uuid);
-        getData(uuid);
-    });
+    showSelected();
 });
 
 refresh.addEventListener('click', (event) => {
+    loadDevices()
+        .then(showSelected)
+        .catch(err => console.error('ListDevices failed:', err));
+});
+
+// Loads the history of the selected devices and streams what follows.
+function showSelected() {
     const selectedValues = Array.from(dropdown.selectedOptions)
         .map(option => option.value);
     selectedValues.forEach(uuid => {
         getData(uuid);
     });
-});
+    subscribe();
+}
 
 
-async function getData(uuid) {
+// Fills the dropdown from the chaincode's device registry, one page of
+// ListDevices at a time.
+async function loadDevices() {
     const client = new grpc.Client(
         peerEndpoint,
         grpc.credentials.createSsl(tlsRoot)
@@ -57,47 +65,123 @@ async function getData(uuid) {
         const network = gateway.getNetwork('sensordata');
         const contract = network.getContract('sensorCC');
 
-        const resultBytes = await contract.evaluateTransaction('QueryDevice', uuid);
-        let jsonStr = resultBytes.toString();
+        const known = new Set(Array.from(dropdown.options).map(option => option.value));
+        let bookmark = '';
+        do {
+            const resultBytes = await contract.evaluateTransaction('ListDevices', '1000', bookmark);
+            const page = JSON.parse(utf8.decode(resultBytes));
+            page.devices.forEach(device => {
+                if (!known.has(device.uuid)) {
+                    known.add(device.uuid);
+                    dropdown.add(new Option(device.uuid, device.uuid));
+                }
+            });
+            bookmark = page.bookmark;
+        } while (bookmark);
+    } finally {
+        gateway.close();
+        client.close();
+    }
+}
+
+loadDevices()
+    .then(showSelected)
+    .catch(err => console.error('ListDevices failed:', err));
 
-        if (/^\d+,/.test(jsonStr)) {
-            const byteArray = Uint8Array.from(
-                jsonStr.split(',').map(n => parseInt(n, 10)));
-            jsonStr = Buffer.from(byteArray).toString('utf8');
-        }
+async function getData(uuid) {
+    const client = new grpc.Client(
+        peerEndpoint,
+        grpc.credentials.createSsl(tlsRoot)
+    );
 
-        const readings = JSON.parse(jsonStr);
-        console.dir(readings, { depth: null });
-        let temperatures = readings.map(r => Number(r.temperature));
-        let humidities = readings.map(r => Number(r.humidity));
-        let pressures = readings.map(r => Number(r.pressure));
-        let tvocs = readings.map(r => Number(r.tvoc));
-        let x = readings.map(r => Number(r.accel_x));
-        let y = readings.map(r => Number(r.accel_y));
-        let z = readings.map(r => Number(r.accel_z));
-        let r = readings.map(r => Number(r.r));
-        let g = readings.map(r => Number(r.g));
-        let b = readings.map(r => Number(r.b));
-
-        addData(tempChart, temperatures, 0);
-        addData(humidChart, humidities, 0);
-        addData(pressChart, pressures, 0);
-        addData(accelChart, x, 0);
-        addData(accelChart, y, 1);
-        addData(accelChart, z, 2);
-        addData(tvocChart, tvocs, 0);
-        addData(rgbChart, r, 0);
-        addData(rgbChart, g, 1);
-        addData(rgbChart, b, 2);
-
-        let timestamps = readings.map(r => (new Date(Number(r.timestamp))).toLocaleString());
-        addLabel(timestamps);
+    const gateway = connect({
+        identity,
+        signer,
+        hash: hash.sha256,
+        client,
+    });
+
+    try {
+        const network = gateway.getNetwork('sensordata');
+        const contract = network.getContract('sensorCC');
+
+        // Only about the window the charts show: they keep the last 60
+        // points, 5 min at 5 s each; ten minutes leaves room for gaps.
+        const from = Date.now() - HISTORY_WINDOW_MS;
+        const resultBytes = await contract.evaluateTransaction(
+            'QueryDeviceRange', uuid, String(from), '18446744073709551615', '1000', '');
+        const { readings } = JSON.parse(utf8.decode(resultBytes));
+        history.set(uuid, readings);
+        render(readings);
     } finally {
         gateway.close();
         client.close();
     }
 }
 
+// Readings shown per device: the window getData() loaded, then whatever the
+// stream pushes.
+const history = new Map();
+
+function render(readings) {
+    let temperatures = readings.map(r => Number(r.temperature));
+    let humidities = readings.map(r => Number(r.humidity));
+    let pressures = readings.map(r => Number(r.pressure));
+    let tvocs = readings.map(r => Number(r.tvoc));
+    let x = readings.map(r => Number(r.accel_x));
+    let y = readings.map(r => Number(r.accel_y));
+    let z = readings.map(r => Number(r.accel_z));
+    let r = readings.map(r => Number(r.r));
+    let g = readings.map(r => Number(r.g));
+    let b = readings.map(r => Number(r.b));
+
+    addData(tempChart, temperatures, 0);
+    addData(humidChart, humidities, 0);
+    addData(pressChart, pressures, 0);
+    addData(accelChart, x, 0);
+    addData(accelChart, y, 1);
+    addData(accelChart, z, 2);
+    addData(tvocChart, tvocs, 0);
+    addData(rgbChart, r, 0);
+    addData(rgbChart, g, 1);
+    addData(rgbChart, b, 2);
+
+    let timestamps = readings.map(r => (new Date(Number(r.timestamp))).toLocaleString());
+    addLabel(timestamps);
+}
+
+// New readings of the selected devices arrive over one WebSocket as they
+// commit, instead of re-querying every 5 s. Reopened whenever the selection
+// changes, and 5 s after the gateway drops it.
+let stream = null;
+
+function subscribe() {
+    if (stream) {
+        stream.onclose = null;
+        stream.close();
+        stream = null;
+    }
+    const uuids = Array.from(dropdown.selectedOptions).map(option => option.value);
+    if (uuids.length === 0) return;
+
+    stream = new WebSocket(`${STREAM_URL}?uuids=${encodeURIComponent(uuids.join(','))}`);
+    stream.onmessage = (event) => {
+        const reading = JSON.parse(event.data);
+        const readings = history.get(reading.uuid);
+        if (!readings) return;
+        const last = readings[readings.length - 1];
+        if (last && (last.timestamp > reading.timestamp
+            || (last.timestamp === reading.timestamp && last.seq === reading.seq))) return;
+        readings.push(reading);
+        history.set(reading.uuid, readings.slice(-60));
+        render(history.get(reading.uuid));
+    };
+    stream.onclose = () => {
+        stream = null;
+        setTimeout(subscribe, 5000);
+    };
+}
+
 function addLabel(labels) {
 
     tempChart.data.labels = labels;
@@ -327,17 +411,3 @@ function addData(chart, newData, index) {
         }
     );
 })();
-
-const intervalId = setInterval(async () => {
-  try {
-    const selectedValues = Array.from(dropdown.selectedOptions)
-        .map(option => option.value);
-    console.log("Running");
-    selectedValues.forEach(async uuid => {
-        // console.log(uuid);
-        await getData(uuid);
-    });
-  } catch (err) {
-    console.error('Task failed:', err);
-  }
-}, 5000);
\ No newline at end of file
@@ -0,0 +1,77 @@
+// Admission control for POST /reading.
+//
+// A base node that misbehaves or replays its backlog in a loop must not
+// crowd out everyone else. Requests are shed before they cost anything
+// further down, cheapest check first:
+//
+//   per-source bucket -> size -> concurrency -> parse -> per-device bucket
+//
+// TokenBuckets holds one bucket per key (the client address, or the
+// device's uuid): it refills at rate tokens/s up to burst, and each
+// reading takes one (a batch of frames, one per frame). An empty bucket
+// sheds the reading with a Retry-After of when the next token is due.
+// Buckets that have refilled completely carry no state, so sweep() drops
+// them; keys are capped at maxKeys, and a key that does not fit is refused
+// rather than let the map grow. Buckets are per process; index.js gives
+// each cluster worker its share of the configured rates.
+//
+// Governor bounds the readings between admission and their answer (body
+// parse, validation, the write-ahead log's fsync), so a flood queues on
+// the socket instead of in memory and behind the pipeline.
+
+class TokenBuckets {
+    constructor({ rate, burst, maxKeys = 100000 }) {
+        this.rate = rate;           // tokens/s; 0 turns the limit off
+        this.burst = burst;
+        this.maxKeys = maxKeys;
+        this.buckets = new Map();   // key -> { tokens, at }
+    }
+
+    // 0 if key may go ahead, else the seconds until it has n tokens.
+    take(key, n = 1, now = performance.now()) {
+        if (!(this.rate > 0)) return 0;
+        let b = this.buckets.get(key);
+        if (!b) {
+            if (this.buckets.size >= this.maxKeys) {
+                this.sweep(now);
+                if (this.buckets.size >= this.maxKeys) return this.burst / this.rate;
+            }
+            this.buckets.set(key, b = { tokens: this.burst, at: now });
+        } else {
+            b.tokens = Math.min(this.burst, b.tokens + (now - b.at) / 1000 * this.rate);
+            b.at = now;
+        }
+        if (b.tokens < n) return (n - b.tokens) / this.rate;
+        b.tokens -= n;
+        return 0;
+    }
+
+    sweep(now = performance.now()) {
+        for (const [key, b] of this.buckets) {
+            if (b.tokens + (now - b.at) / 1000 * this.rate >= this.burst) this.buckets.delete(key);
+        }
+    }
+
+    get size() {
+        return this.buckets.size;
+    }
+}
+
+class Governor {
+    constructor(limit) {
+        this.limit = limit;
+        this.active = 0;
+    }
+
+    enter() {
+        if (this.active >= this.limit) return false;
+        this.active++;
+        return true;
+    }
+
+    leave() {
+        this.active--;
+    }
+}
+
+module.exports = { TokenBuckets, Governor };
@@ -0,0 +1,267 @@
+// Anchoring mode: readings stay off-chain in a local content-addressed
+// store and only a Merkle root per batch window is committed, through the
+// chaincode's AnchorBatch. Any reading can later be checked against the
+// ledger with VerifyReading and the proof from proof().
+//
+// Layout under dir:
+//   objects/ab/abcdef...   reading bytes, named by their leaf hash
+//   batches/<id>.json      { batchId, root, from, to, leaves[], anchored }
+//                          (plus conflict, the root on the ledger, if that
+//                          is not ours)
+//   window/                write-ahead log (wal.js) of { leaf, ts } for the
+//                          readings not sealed into a batch yet
+//
+// append() returns once the reading's object and its record in the window
+// log are both on disk, so the open window survives a restart (and never
+// names an object that is not there): seal() reads it back from the log and
+// moves the checkpoint past it once the manifest is written. A reading
+// whose leaf already has a manifest (sealed just before a crash, or the
+// same bytes stored twice) is not sealed again.
+//
+// A batch id is the gateway, the window's first timestamp and a prefix of
+// the root, so two batches only share an id if they share their leaves. A
+// batch the ledger reports as already anchored is therefore one submitted
+// before; its root on the ledger is read back and compared all the same.
+//
+// Tree shape must match Chaincode/anchor.go:
+//   leaf = sha256(0x00 || bytes), node = sha256(0x01 || left || right),
+//   an odd node at the end of a level is carried up unchanged.
+
+const fs = require('fs/promises');
+const path = require('path');
+const crypto = require('crypto');
+const os = require('os');
+const { log } = require('./log');
+const { WriteAheadLog } = require('./wal');
+
+function sha256(...parts) {
+    const h = crypto.createHash('sha256');
+    parts.forEach(p => h.update(p));
+    return h.digest();
+}
+
+const LEAF = Buffer.from([0x00]);
+const NODE = Buffer.from([0x01]);
+
+const leafHash = data => sha256(LEAF, data);
+const nodeHash = (left, right) => sha256(NODE, left, right);
+
+// levels[0] are the leaves, the last level holds only the root
+function buildLevels(leaves) {
+    const levels = [leaves];
+    while (levels[levels.length - 1].length > 1) {
+        const level = levels[levels.length - 1];
+        const next = [];
+        for (let i = 0; i < level.length; i += 2) {
+            next.push(i + 1 < level.length ? nodeHash(level[i], level[i + 1]) : level[i]);
+        }
+        levels.push(next);
+    }
+    return levels;
+}
+
+function proofFor(levels, index) {
+    const steps = [];
+    for (let l = 0; l < levels.length - 1; l++) {
+        const sib = index ^ 1;
+        if (sib < levels[l].length) {
+            steps.push({ hash: levels[l][sib].toString('hex'), left: sib < index });
+        }
+        index >>= 1;
+    }
+    return steps;
+}
+
+// Writes data to file through a temporary name and fsyncs the file and
+// then its directory, so file is either absent or complete after a crash.
+async function writeDurable(file, data) {
+    const tmp = `${file}.${process.pid}.${crypto.randomBytes(4).toString('hex')}.tmp`;
+    const fh = await fs.open(tmp, 'w');
+    try {
+        await fh.writeFile(data);
+        await fh.sync();
+    } finally {
+        await fh.close();
+    }
+    await fs.rename(tmp, file);
+    await syncDir(path.dirname(file));
+}
+
+async function syncDir(dir) {
+    const fh = await fs.open(dir, 'r');
+    try {
+        await fh.sync();
+    } finally {
+        await fh.close();
+    }
+}
+
+class AnchorStore {
+    // ledger.anchor: async (batchId, rootHex, from, to, count) => void
+    // ledger.getAnchor: async batchId => { root } as anchored on the ledger
+    constructor(dir, ledger, { windowMs = 60000, maxLeaves = 10000 } = {}) {
+        this.dir = dir;
+        this.ledger = ledger;
+        this.windowMs = windowMs;
+        this.maxLeaves = maxLeaves;
+        this.gatewayId = process.env.GATEWAY_ID || os.hostname();
+        this.window = new WriteAheadLog(path.join(dir, 'window'));
+        this.index = new Map();     // leaf hex -> { batchId, index }
+        this.unanchored = [];       // manifests whose AnchorBatch failed
+        this.lastSeal = Promise.resolve();
+        this.sealQueued = false;
+    }
+
+    async init() {
+        await fs.mkdir(path.join(this.dir, 'objects'), { recursive: true });
+        await fs.mkdir(path.join(this.dir, 'batches'), { recursive: true });
+
+        for (const name of await fs.readdir(path.join(this.dir, 'batches'))) {
+            if (!name.endsWith('.json')) continue;
+            const m = await this.readManifest(name.slice(0, -'.json'.length));
+            m.leaves.forEach((leaf, i) => this.index.set(leaf, { batchId: m.batchId, index: i }));
+            if (!m.anchored && !m.conflict) this.unanchored.push(m);
+        }
+        await this.window.open();
+
+        this.timer = setInterval(() => this.sealQuietly(), this.windowMs);
+        this.timer.unref();
+    }
+
+    // Seals what is left of the window and closes its log.
+    async close() {
+        clearInterval(this.timer);
+        await this.seal().catch(err => log.error('anchor seal failed', { error: err.message }));
+        await this.window.close();
+    }
+
+    objectPath(hex) {
+        return path.join(this.dir, 'objects', hex.slice(0, 2), hex);
+    }
+
+    async append(bytes, ts) {
+        const leaf = leafHash(bytes);
+        const hex = leaf.toString('hex');
+        const file = this.objectPath(hex);
+        // Same content, same name: rewriting an object that exists only
+        // replaces it with the same bytes.
+        if (await fs.mkdir(path.dirname(file), { recursive: true })) {
+            await syncDir(path.join(this.dir, 'objects'));
+        }
+        await writeDurable(file, bytes);
+
+        await this.window.append(Buffer.from(JSON.stringify({ leaf: hex, ts })));
+        // The reading is stored either way; a failed seal is retried by the
+        // next one.
+        if (!this.sealQueued && this.window.stats().unread >= this.maxLeaves) {
+            this.sealQueued = true;
+            this.sealQuietly(false).finally(() => { this.sealQueued = false; });
+        }
+        return hex;
+    }
+
+    sealQuietly(all) {
+        return this.seal(all).catch(err => log.error('anchor seal failed', { error: err.message }));
+    }
+
+    // Seals run one at a time; each takes what the window log holds past
+    // the last one, in batches of up to maxLeaves, or with all false only
+    // the full batches.
+    seal(all = true) {
+        const run = this.lastSeal.then(() => this.sealWindow(all));
+        this.lastSeal = run.catch(() => {});
+        return run;
+    }
+
+    // A batch whose manifest cannot be written stays in the window log and
+    // is sealed again after the next start.
+    async sealWindow(all) {
+        for (const m of this.unanchored.splice(0)) {
+            await this.submit(m);
+        }
+        while (this.window.stats().unread >= (all ? 1 : this.maxLeaves)) {
+            const records = await this.window.read(this.maxLeaves);
+            const window = records
+                .map(r => JSON.parse(r.payload))
+                .filter(w => !this.index.has(w.leaf))
+                .map(w => ({ leaf: Buffer.from(w.leaf, 'hex'), ts: w.ts }));
+            if (window.length > 0) await this.sealBatch(window);
+            this.window.commit(records.map(r => r.lsn));
+        }
+    }
+
+    async sealBatch(window) {
+        const levels = buildLevels(window.map(w => w.leaf));
+        // Readings need not arrive in time order; the window spans them all.
+        let from = window[0].ts;
+        let to = from;
+        for (const w of window) {
+            if (w.ts < from) from = w.ts;
+            if (w.ts > to) to = w.ts;
+        }
+        const root = levels[levels.length - 1][0].toString('hex');
+        const m = {
+            batchId: `${this.gatewayId}-${from}-${root.slice(0, 16)}`,
+            root,
+            from,
+            to,
+            leaves: window.map(w => w.leaf.toString('hex')),
+            anchored: false,
+        };
+        await this.writeManifest(m);
+        m.leaves.forEach((leaf, i) => this.index.set(leaf, { batchId: m.batchId, index: i }));
+        await this.submit(m);
+    }
+
+    // A failed AnchorBatch is logged and leaves the manifest unanchored on
+    // disk; the next seal (or the next start) retries it. A batch already
+    // on the ledger with another root is not ours to claim: the manifest
+    // records the conflict, stays unanchored and is not retried.
+    async submit(m) {
+        try {
+            try {
+                await this.ledger.anchor(m.batchId, m.root, m.from, m.to, m.leaves.length);
+            } catch (err) {
+                if (!/already anchored/.test(err.message)) throw err;
+                const { root } = await this.ledger.getAnchor(m.batchId);
+                if (root !== m.root) {
+                    log.error('anchor root mismatch', { batchId: m.batchId, root: m.root, ledgerRoot: root });
+                    m.conflict = root;
+                    await this.writeManifest(m);
+                    return;
+                }
+            }
+        } catch (err) {
+            log.error('anchor submit failed', { batchId: m.batchId, error: err.message });
+            this.unanchored.push(m);
+            return;
+        }
+        m.anchored = true;
+        await this.writeManifest(m);
+    }
+
+    async proof(leafHex) {
+        const loc = this.index.get(leafHex);
+        if (!loc) return null;
+        const m = await this.readManifest(loc.batchId);
+        const levels = buildLevels(m.leaves.map(h => Buffer.from(h, 'hex')));
+        return {
+            batchId: m.batchId,
+            root: m.root,
+            anchored: m.anchored,
+            conflict: m.conflict,
+            reading: (await fs.readFile(this.objectPath(leafHex))).toString('utf8'),
+            proof: proofFor(levels, loc.index),
+        };
+    }
+
+    async readManifest(batchId) {
+        return JSON.parse(await fs.readFile(path.join(this.dir, 'batches', `${batchId}.json`), 'utf8'));
+    }
+
+    async writeManifest(m) {
+        await writeDurable(path.join(this.dir, 'batches', `${m.batchId}.json`), JSON.stringify(m));
+    }
+}
+
+module.exports = { AnchorStore, leafHash, nodeHash, buildLevels, proofFor };
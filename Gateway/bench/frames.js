@@ -0,0 +1,53 @@
+// Decode throughput for packed sensor frames (frames.js): the JavaScript
+// decoder, one DataView read per field, against the native one.
+//
+//   node bench/frames.js [seconds per case, default 2] [frames per batch, default 256]
+//
+// Each case decodes the same batch (one frame in 50 with a bad prefix)
+// over and over and reports frames/s. The native cases are skipped when
+// the addon is not built (npm install builds it with node-gyp).
+
+const assert = require('assert');
+const frames = require('../frames');
+
+const seconds = Number(process.argv[2] || 2);
+const batch = Number(process.argv[3] || 256);
+
+const buf = Buffer.alloc(batch * frames.FRAME_SIZE);
+for (let i = 0; i < batch; i++) {
+    const at = i * frames.FRAME_SIZE;
+    buf.writeUInt32BE(i % 50 === 49 ? 0 : 0xa3f9c2b7, at);
+    buf.write(`D${String(i % 1000).padStart(3, '0')}`, at + 4, 'latin1');
+    buf.writeUInt16LE(i & 0xffff, at + 8);
+    for (let j = 10; j < 16; j++) buf[at + j] = (i * j) & 0xff;
+    buf.writeUInt16LE((i * 7) & 0xffff, at + 16);
+    for (let j = 18; j < 21; j++) buf.writeInt8(((i + j) % 256) - 128, at + j);
+}
+
+function run(name, fn) {
+    for (let i = 0; i < 1000; i++) fn(buf);
+    let n = 0;
+    const started = process.hrtime.bigint();
+    const until = started + BigInt(seconds * 1e9);
+    while (process.hrtime.bigint() < until) {
+        for (let i = 0; i < 100; i++) fn(buf);
+        n += 100 * batch;
+    }
+    const s = Number(process.hrtime.bigint() - started) / 1e9;
+    console.log(`${name.padEnd(18)} ${Math.round(n / s).toString().padStart(11)} frames/s  ${(s / n * 1e9).toFixed(1).padStart(6)} ns/frame`);
+}
+
+run('js, columns', frames.decodeJs);
+run('js, objects', frames.decodeObjectsJs);
+if (frames.native) {
+    // Both decoders must agree before their speeds mean anything.
+    const js = frames.decodeJs(buf);
+    const c = frames.decode(buf);
+    for (const key of Object.keys(js)) assert.deepStrictEqual(c[key], js[key], key);
+    assert.deepStrictEqual(frames.decodeObjects(buf), frames.decodeObjectsJs(buf));
+
+    run('native, columns', frames.decode);
+    run('native, objects', frames.decodeObjects);
+} else {
+    console.log('native decoder not built; run npm install');
+}
@@ -0,0 +1,128 @@
+// Load generator for POST /reading.
+//
+//   node bench/load.js [url] [--connections 64] [--seconds 10] [--devices 100]
+//   node bench/load.js --sweep 1,2,4,8 [--connections 64] [--seconds 10]
+//
+// Keeps --connections requests outstanding over keep-alive sockets for
+// --seconds and reports requests/s, latency percentiles and status codes.
+// With --sweep it starts the gateway itself (cluster.js) once per worker
+// count, on a spare port with a scratch write-ahead log, and prints one
+// line per count, which shows how the acknowledgement path scales with
+// cores. The ack path stops at the fsynced log, so a sweep needs no peer.
+
+const http = require('http');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { spawn } = require('child_process');
+
+function parseArgs(argv) {
+    const opts = { url: 'http://localhost:3000/reading', connections: 64, seconds: 10, devices: 100, sweep: null };
+    for (let i = 0; i < argv.length; i++) {
+        const a = argv[i];
+        if (a === '--connections') opts.connections = Number(argv[++i]);
+        else if (a === '--seconds') opts.seconds = Number(argv[++i]);
+        else if (a === '--devices') opts.devices = Number(argv[++i]);
+        else if (a === '--sweep') opts.sweep = argv[++i].split(',').map(Number);
+        else opts.url = a;
+    }
+    return opts;
+}
+
+async function load(url, { connections, seconds, devices }) {
+    const target = new URL(url);
+    const agent = new http.Agent({ keepAlive: true, maxSockets: connections });
+    const latencies = [];
+    const statuses = {};
+    let counter = 0;
+    const until = Date.now() + seconds * 1000;
+
+    const post = () => new Promise(resolve => {
+        const n = counter++;
+        const body = JSON.stringify({
+            uuid: `D${String(n % devices).padStart(3, '0')}`, timestamp: String(n >>> 0),
+            pressure: '101', humidity: '63', temperature: '24', r: '120', g: '98', b: '77',
+            tvoc: '231', accel_x: '-7', accel_y: '1', accel_z: '9',
+        });
+        const started = process.hrtime.bigint();
+        const req = http.request(target, {
+            method: 'POST', agent,
+            headers: { 'Content-Type': 'application/json', 'Content-Length': Buffer.byteLength(body) },
+        }, res => {
+            res.resume();
+            res.on('end', () => {
+                latencies.push(Number(process.hrtime.bigint() - started) / 1e6);
+                statuses[res.statusCode] = (statuses[res.statusCode] || 0) + 1;
+                resolve();
+            });
+        });
+        req.on('error', err => {
+            statuses[err.code || 'error'] = (statuses[err.code || 'error'] || 0) + 1;
+            resolve();
+        });
+        req.end(body);
+    });
+
+    const started = Date.now();
+    await Promise.all(Array.from({ length: connections }, async () => {
+        while (Date.now() < until) await post();
+    }));
+    const elapsed = (Date.now() - started) / 1000;
+    agent.destroy();
+
+    latencies.sort((a, b) => a - b);
+    const q = p => latencies.length ? latencies[Math.min(latencies.length - 1, Math.floor(p * latencies.length))] : 0;
+    return { rps: latencies.length / elapsed, p50: q(0.5), p99: q(0.99), max: q(1), statuses };
+}
+
+const line = r => `${Math.round(r.rps).toString().padStart(8)} req/s  p50 ${r.p50.toFixed(1)} ms  ` +
+    `p99 ${r.p99.toFixed(1)} ms  max ${r.max.toFixed(1)} ms  ${JSON.stringify(r.statuses)}`;
+
+async function waitForPort(port, ms = 30000) {
+    const until = Date.now() + ms;
+    while (Date.now() < until) {
+        const up = await new Promise(resolve => {
+            http.get({ port, path: '/pipeline' }, res => { res.resume(); resolve(true); })
+                .on('error', () => resolve(false));
+        });
+        if (up) return;
+        await new Promise(resolve => setTimeout(resolve, 200));
+    }
+    throw new Error(`gateway did not come up on :${port}`);
+}
+
+async function sweep(opts) {
+    for (const workers of opts.sweep) {
+        const port = 3100 + workers;
+        const scratch = fs.mkdtempSync(path.join(os.tmpdir(), 'gateway-load-'));
+        const gateway = spawn(process.execPath, [path.join(__dirname, '..', 'cluster.js')], {
+            cwd: path.join(__dirname, '..'),
+            env: {
+                ...process.env, GATEWAY_WORKERS: String(workers), PORT: String(port),
+                WAL_DIR: path.join(scratch, 'wal'), MIRROR_DB: path.join(scratch, 'mirror.db'),
+                EVENT_CHECKPOINT: path.join(scratch, 'events.json'), LOG_SAMPLE_RATE: '0',
+            },
+            stdio: 'ignore',
+        });
+        try {
+            await waitForPort(port);
+            const r = await load(`http://localhost:${port}/reading`, opts);
+            console.log(`${String(workers).padStart(2)} workers ${line(r)}`);
+        } finally {
+            gateway.kill('SIGTERM');
+            await new Promise(resolve => gateway.on('exit', resolve));
+            fs.rmSync(scratch, { recursive: true, force: true });
+        }
+    }
+}
+
+module.exports = { load, waitForPort };
+
+if (require.main === module) {
+    const opts = parseArgs(process.argv.slice(2));
+    if (opts.sweep) {
+        sweep(opts).catch(err => { console.error(err.message); process.exit(1); });
+    } else {
+        load(opts.url, opts).then(r => console.log(line(r)));
+    }
+}
@@ -0,0 +1,64 @@
+// Per-core cost of handling one POST /reading body, before and after the
+// compiled schema (schema.js). Both start from the raw body express.json()
+// would parse and end with the bytes appended to the write-ahead log.
+//
+//   node bench/reading.js [seconds per case, default 2]
+//
+// "before" is the handler as it was: coerce every entry with isNaN,
+// console.log the object and its JSON (here to /dev/null), stringify again
+// for the log. "after" is validateIncoming + serializeReading.
+
+const fs = require('fs');
+const util = require('util');
+const { validateIncoming, serializeReading } = require('../schema');
+
+const seconds = Number(process.argv[2] || 2);
+const devNull = fs.openSync('/dev/null', 'w');
+
+const body = JSON.stringify({
+    uuid: 'AB12', timestamp: '4711', pressure: '101', humidity: '63', temperature: '24',
+    r: '120', g: '98', b: '77', tvoc: '231', accel_x: '-7', accel_y: '1', accel_z: '9',
+});
+const malformed = JSON.stringify({ uuid: 'AB12', timestamp: '4711', r: '300' });
+
+function before(text) {
+    const r = JSON.parse(text);
+    r.seq = Number(r.timestamp) >>> 0;
+    r.timestamp = Date.now();
+    fs.writeSync(devNull, util.format(r) + '\n');
+    const output = Object.fromEntries(
+        Object.entries(r).map(([key, val]) => [
+            key,
+            (typeof val === 'string' && val.trim() !== '' && !isNaN(val))
+                ? Number(val)
+                : val
+        ])
+    );
+    fs.writeSync(devNull, JSON.stringify(output) + '\n');
+    return Buffer.from(JSON.stringify(output));
+}
+
+function after(text) {
+    const r = validateIncoming(JSON.parse(text));
+    if (!r) return null;
+    r.seq = r.timestamp;
+    r.timestamp = Date.now();
+    return Buffer.from(serializeReading(r));
+}
+
+function run(name, fn, text) {
+    for (let i = 0; i < 10000; i++) fn(text);
+    let n = 0;
+    const started = process.hrtime.bigint();
+    const until = started + BigInt(seconds * 1e9);
+    while (process.hrtime.bigint() < until) {
+        for (let i = 0; i < 1000; i++) fn(text);
+        n += 1000;
+    }
+    const s = Number(process.hrtime.bigint() - started) / 1e9;
+    console.log(`${name.padEnd(18)} ${Math.round(n / s).toString().padStart(10)} bodies/s  ${(s / n * 1e9).toFixed(0).padStart(6)} ns/body`);
+}
+
+run('before', before, body);
+run('after', after, body);
+run('after, malformed', after, malformed);
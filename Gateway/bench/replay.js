@@ -0,0 +1,217 @@
+// Replays base-node traffic against a gateway running on the stand-in
+// ledger (standin.js), so the whole write path can be load tested on one
+// box with no peer or orderer.
+//
+//   node bench/replay.js [--devices 500] [--interval 5] [--seconds 60]
+//       [--burst-every 20] [--burst-devices 0.2] [--burst-size 12]
+//       [--workers 0] [--connections 32] [--flood 0]
+//
+// Every device posts a reading each --interval seconds (+-10%), starting
+// at a random phase, as the base node forwards adverts. Every
+// --burst-every seconds a --burst-devices fraction of them also sends a
+// backlog of --burst-size readings back to back, as after the base node
+// reconnects. The gateway is started here with LEDGER_BACKEND=standin and
+// scratch state: index.js, or cluster.js with --workers N. STANDIN_* in
+// the environment set the stand-in's latencies. --flood N adds N
+// connections from another address (127.0.0.2) that each post one
+// device's readings back to back, as a base node stuck replaying would;
+// the latencies reported are the well-behaved devices' only.
+//
+// Reports acknowledgements/s, latency percentiles and status codes, how
+// long the ledger took to commit everything acknowledged, and the peak
+// resident memory of the gateway and its workers.
+
+const http = require('http');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { spawn } = require('child_process');
+const { waitForPort } = require('./load');
+
+const PORT = 3099;
+const DRAIN_TIMEOUT_MS = 60000;
+
+function parseArgs(argv) {
+    const opts = {
+        devices: 500, interval: 5, seconds: 60, burstEvery: 20, burstDevices: 0.2, burstSize: 12,
+        workers: 0, connections: 32, flood: 0,
+    };
+    const names = {
+        '--devices': 'devices', '--interval': 'interval', '--seconds': 'seconds',
+        '--burst-every': 'burstEvery', '--burst-devices': 'burstDevices', '--burst-size': 'burstSize',
+        '--workers': 'workers', '--connections': 'connections', '--flood': 'flood',
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (!names[argv[i]]) throw new Error(`unknown option ${argv[i]}`);
+        opts[names[argv[i]]] = Number(argv[++i]);
+    }
+    return opts;
+}
+
+function get(pathname) {
+    return new Promise((resolve, reject) => {
+        http.get({ port: PORT, path: pathname }, res => {
+            let body = '';
+            res.on('data', chunk => body += chunk);
+            res.on('end', () => resolve(JSON.parse(body)));
+        }).on('error', reject);
+    });
+}
+
+// Resident memory of pid and its descendants, in bytes.
+function rss(pid) {
+    let total = 0;
+    try {
+        const status = fs.readFileSync(`/proc/${pid}/status`, 'utf8');
+        total += Number(/VmRSS:\s+(\d+) kB/.exec(status)?.[1] || 0) * 1024;
+        const children = fs.readFileSync(`/proc/${pid}/task/${pid}/children`, 'utf8').trim();
+        for (const child of children ? children.split(' ') : []) total += rss(child);
+    } catch {
+        // Exited while we looked.
+    }
+    return total;
+}
+
+async function replay(opts) {
+    const agent = new http.Agent({ keepAlive: true, maxSockets: opts.connections });
+    const latencies = [];
+    const statuses = {};
+    const counters = new Array(opts.devices).fill(0);
+    const timers = new Set();
+    const pending = new Set();
+
+    const request = (uuid, timestamp, via, done) => {
+        const body = JSON.stringify({
+            uuid, timestamp: String(timestamp),
+            pressure: '101', humidity: '63', temperature: '24', r: '120', g: '98', b: '77',
+            tvoc: '231', accel_x: '-7', accel_y: '1', accel_z: '9',
+        });
+        const started = process.hrtime.bigint();
+        const req = http.request({ port: PORT, path: '/reading', method: 'POST', agent: via,
+            headers: { 'Content-Type': 'application/json', 'Content-Length': Buffer.byteLength(body) },
+        }, res => {
+            res.resume();
+            res.on('end', () => done(res.statusCode, Number(process.hrtime.bigint() - started) / 1e6));
+        });
+        req.on('error', err => done(err.code || 'error'));
+        req.end(body);
+    };
+
+    const post = device => {
+        const done = new Promise(resolve => {
+            request(`D${String(device).padStart(4, '0')}`, ++counters[device], agent, (status, ms) => {
+                if (ms !== undefined) latencies.push(ms);
+                statuses[status] = (statuses[status] || 0) + 1;
+                resolve();
+            });
+        });
+        pending.add(done);
+        done.then(() => pending.delete(done));
+        return done;
+    };
+
+    const at = (ms, fn) => {
+        const t = setTimeout(() => { timers.delete(t); fn(); }, ms);
+        timers.add(t);
+    };
+
+    const interval = opts.interval * 1000;
+    const tick = device => {
+        post(device);
+        at(interval * (0.9 + 0.2 * Math.random()), () => tick(device));
+    };
+    for (let d = 0; d < opts.devices; d++) at(Math.random() * interval, () => tick(d));
+
+    const burst = () => {
+        for (let d = 0; d < opts.devices; d++) {
+            if (Math.random() >= opts.burstDevices) continue;
+            (async () => { for (let i = 0; i < opts.burstSize; i++) await post(d); })();
+        }
+        at(opts.burstEvery * 1000, burst);
+    };
+    if (opts.burstEvery > 0) at(opts.burstEvery * 1000, burst);
+
+    const started = Date.now();
+    const until = started + opts.seconds * 1000;
+    const flooder = new http.Agent({ keepAlive: true, maxSockets: opts.flood, localAddress: '127.0.0.2' });
+    const flooded = {};
+    const floods = Array.from({ length: opts.flood }, async (_, n) => {
+        for (let i = 1; Date.now() < until; i++) {
+            await new Promise(resolve => request(`F${n}`, i, flooder, status => {
+                flooded[status] = (flooded[status] || 0) + 1;
+                resolve();
+            }));
+        }
+    });
+
+    await new Promise(resolve => setTimeout(resolve, opts.seconds * 1000));
+    timers.forEach(clearTimeout);
+    while (pending.size > 0) await Promise.all(pending);
+    await Promise.all(floods);
+    const elapsed = (Date.now() - started) / 1000;
+    agent.destroy();
+    flooder.destroy();
+
+    latencies.sort((a, b) => a - b);
+    const q = p => latencies.length ? latencies[Math.min(latencies.length - 1, Math.floor(p * latencies.length))] : 0;
+    return {
+        acked: statuses[202] || 0, rps: latencies.length / elapsed,
+        p50: q(0.5), p99: q(0.99), p999: q(0.999), max: q(1), statuses, flooded,
+    };
+}
+
+// Waits until the write-ahead log is empty, i.e. everything acknowledged
+// has committed on the stand-in. Only this process's log is visible, so
+// with --workers this covers the one worker that answers.
+async function drained() {
+    const started = Date.now();
+    while (Date.now() - started < DRAIN_TIMEOUT_MS) {
+        const p = await get('/pipeline');
+        if (p.wal.depth === 0) return { ms: Date.now() - started, pipeline: p };
+        await new Promise(resolve => setTimeout(resolve, 100));
+    }
+    throw new Error('the write-ahead log did not drain');
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const scratch = fs.mkdtempSync(path.join(os.tmpdir(), 'gateway-replay-'));
+    const script = opts.workers > 0 ? 'cluster.js' : 'index.js';
+    const gateway = spawn(process.execPath, [path.join(__dirname, '..', script)], {
+        cwd: path.join(__dirname, '..'),
+        env: {
+            ...process.env, LEDGER_BACKEND: 'standin', PORT: String(PORT),
+            GATEWAY_WORKERS: String(opts.workers), WAL_DIR: path.join(scratch, 'wal'),
+            MIRROR_DB: path.join(scratch, 'mirror.db'), EVENT_CHECKPOINT: path.join(scratch, 'events.json'),
+            LOG_SAMPLE_RATE: '0',
+        },
+        stdio: ['ignore', 'ignore', 'inherit'],
+    });
+    let peak = 0;
+    const sampler = setInterval(() => { peak = Math.max(peak, rss(gateway.pid)); }, 250);
+    try {
+        await waitForPort(PORT);
+        const r = await replay(opts);
+        const { ms, pipeline } = await drained();
+        peak = Math.max(peak, rss(gateway.pid));
+        const mib = bytes => `${(bytes / 1048576).toFixed(1)} MiB`;
+        console.log(`${opts.devices} devices every ${opts.interval} s, ${opts.seconds} s, ` +
+            `${script}${opts.workers > 0 ? ` x${opts.workers}` : ''}`);
+        console.log(`  acked     ${r.acked} (${r.rps.toFixed(1)} req/s)  ${JSON.stringify(r.statuses)}`);
+        console.log(`  latency   p50 ${r.p50.toFixed(1)} ms  p99 ${r.p99.toFixed(1)} ms  ` +
+            `p999 ${r.p999.toFixed(1)} ms  max ${r.max.toFixed(1)} ms`);
+        if (opts.flood > 0) console.log(`  flood     ${JSON.stringify(r.flooded)}`);
+        console.log(`  ledger    ${JSON.stringify(pipeline.ledger)}, drained ${ms} ms after the last ack`);
+        const { accepted, committed, rejected, retried } = pipeline;
+        console.log(`  pipeline  ${JSON.stringify({ accepted, committed, rejected, retried })}`);
+        console.log(`  shed      ${JSON.stringify(pipeline.admission.shed)}`);
+        console.log(`  memory    peak rss ${mib(peak)}, heap ${mib(pipeline.memory.heapUsed)}`);
+    } finally {
+        clearInterval(sampler);
+        gateway.kill('SIGTERM');
+        await new Promise(resolve => gateway.on('exit', resolve));
+        fs.rmSync(scratch, { recursive: true, force: true });
+    }
+}
+
+main().catch(err => { console.error(err.message); process.exit(1); });
@@ -0,0 +1,10 @@
+{
+  "targets": [
+    {
+      "target_name": "frames",
+      "sources": ["native/frames.c"],
+      "include_dirs": ["../mylib"],
+      "cflags": ["-O3", "-Wall", "-Wextra"]
+    }
+  ]
+}
@@ -0,0 +1,109 @@
+// Cluster mode: node cluster.js runs GATEWAY_WORKERS copies of index.js
+// (default: one per core) behind the same port, so JSON parsing,
+// validation and proposal signing use every core.
+//
+// Each worker gets a stable WORKER_INDEX and with it its own write-ahead
+// log directory, event checkpoint and Fabric connection pool; worker 0 is
+// also the one that follows blocks into the mirror and runs compaction.
+// A worker that dies is restarted with the same index, so it recovers its
+// own log. SIGINT or SIGTERM asks every worker to shut down gracefully
+// (stop accepting, let in-flight submits finish, checkpoint the log) and
+// exits once they all have.
+//
+// No worker reads another's log. A worker-<n> log left by an earlier run
+// with more workers (n >= GATEWAY_WORKERS) would never be sent, so the
+// primary refuses to start while one still holds records past its
+// checkpoint; start once with enough workers to drain it.
+
+const cluster = require('cluster');
+const fs = require('fs/promises');
+const os = require('os');
+const path = require('path');
+const { log } = require('./log');
+const { WriteAheadLog } = require('./wal');
+
+const WORKERS = Number(process.env.GATEWAY_WORKERS || os.availableParallelism());
+const RESTART_DELAY_MS = 1000;
+
+cluster.setupPrimary({ exec: path.join(__dirname, 'index.js') });
+
+const byIndex = new Map();  // index -> worker
+let stopping = false;
+
+function start(index) {
+    const worker = cluster.fork({ WORKER_INDEX: String(index), GATEWAY_WORKERS: String(WORKERS) });
+    byIndex.set(index, worker);
+    worker.on('exit', (code, signal) => {
+        byIndex.delete(index);
+        if (stopping) {
+            if (byIndex.size === 0) exit(0);
+            return;
+        }
+        log.error('worker exited, restarting', { worker: index, code, signal });
+        setTimeout(() => start(index), RESTART_DELAY_MS);
+    });
+}
+
+// [{ dir, records }] for the worker logs no worker will drain.
+async function orphanedLogs() {
+    const dir = process.env.WAL_DIR || './wal';
+    let names;
+    try {
+        names = await fs.readdir(dir);
+    } catch (err) {
+        if (err.code === 'ENOENT') return [];
+        throw err;
+    }
+    const orphans = [];
+    for (const name of names) {
+        const m = /^worker-(\d+)$/.exec(name);
+        if (!m || Number(m[1]) < WORKERS) continue;
+        const wal = new WriteAheadLog(path.join(dir, name));
+        await wal.open();
+        const { depth } = wal.stats();
+        await wal.close();
+        if (depth > 0) orphans.push({ dir: path.join(dir, name), worker: Number(m[1]), records: depth });
+    }
+    return orphans;
+}
+
+// Whether the workers can be started; logs why not.
+async function preflight() {
+    if (process.env.LEDGER_MODE === 'anchor') {
+        log.error('anchor mode keeps a single store; run index.js directly');
+        return false;
+    }
+    const orphans = await orphanedLogs();
+    if (orphans.length > 0) {
+        log.error('undrained worker logs; start with more workers to send them', {
+            workers: WORKERS, needed: 1 + Math.max(...orphans.map(o => o.worker)), orphans,
+        });
+        return false;
+    }
+    return true;
+}
+
+preflight().then(ok => {
+    if (!ok) return exit(1);
+    for (let i = 0; i < WORKERS; i++) start(i);
+}, err => {
+    log.error('worker log check failed', { error: err.message });
+    exit(1);
+});
+
+// process.exit() once the log is written.
+function exit(code) {
+    log.flush().then(() => process.exit(code));
+}
+
+function stop() {
+    if (stopping) return;
+    stopping = true;
+    if (byIndex.size === 0) exit(0);
+    for (const worker of byIndex.values()) {
+        if (worker.isConnected()) worker.send('shutdown');
+    }
+}
+
+process.on('SIGINT', stop);
+process.on('SIGTERM', stop);
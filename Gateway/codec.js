@@ -0,0 +1,35 @@
+// Decoder for ledger values, mirroring Chaincode/codec.go.
+//
+// v1 layout, big endian: version(1) ts(8) seq(4) pressure humidity
+// temperature (float64 bits, 8 each) r g b (1 each) tvoc(2) accel_x accel_y
+// accel_z (int8 each) len(uuid)(1) uuid. Older values are JSON.
+
+const V1 = 1;
+const V1_FIXED = 46;
+
+function decodeValue(b) {
+    if (b.length === 0) throw new Error('empty reading value');
+    if (b[0] === 0x7b) return JSON.parse(Buffer.from(b).toString('utf8')); // '{'
+    if (b[0] !== V1) throw new Error(`unknown reading format version ${b[0]}`);
+    if (b.length < V1_FIXED || b.length !== V1_FIXED + b[45]) {
+        throw new Error(`truncated v1 reading (${b.length} bytes)`);
+    }
+    const v = new DataView(b.buffer, b.byteOffset, b.byteLength);
+    return {
+        uuid: Buffer.from(b.buffer, b.byteOffset + V1_FIXED, b[45]).toString('utf8'),
+        timestamp: Number(v.getBigUint64(1)),
+        seq: v.getUint32(9),
+        pressure: v.getFloat64(13),
+        humidity: v.getFloat64(21),
+        temperature: v.getFloat64(29),
+        r: b[37],
+        g: b[38],
+        b: b[39],
+        tvoc: v.getUint16(40),
+        accel_x: v.getInt8(42),
+        accel_y: v.getInt8(43),
+        accel_z: v.getInt8(44),
+    };
+}
+
+module.exports = { decodeValue };
@@ -0,0 +1,74 @@
+// A small pool of Fabric Gateway connections for one gateway process.
+//
+// Each member is its own gRPC channel to the peer (a local subchannel
+// pool, so grpc-js does not fold them onto one HTTP/2 connection) with its
+// own connect() gateway. Calls are spread over the members round-robin,
+// so concurrent evaluates and CreateReadings batches do not queue behind
+// each other's HTTP/2 flow control on a single stream. pool.contract has
+// the Contract methods the gateway uses and picks a member per call; every
+// step of one proposal stays on the member that created it.
+//
+// Connections cannot be handed between processes, so in cluster mode
+// (cluster.js) every worker has its own pool and signs its own proposals.
+
+const fs = require('fs');
+const crypto = require('crypto');
+const grpc = require('@grpc/grpc-js');
+const { connect, signers, hash } = require('@hyperledger/fabric-gateway');
+
+class FabricPool {
+    constructor(size, {
+        peerEndpoint = 'peer0.org1.example.com:7051',
+        hostAlias = 'peer0.org1.example.com',
+        mspId = 'Org1MSP',
+        keyDir = './keys',
+        channel = 'sensordata',
+        chaincode = 'sensorCC',
+    } = {}) {
+        const certPem = fs.readFileSync(`${keyDir}/cert.pem`);
+        const keyPem = fs.readFileSync(`${keyDir}/key.pem`);
+        const tlsRoot = fs.readFileSync(`${keyDir}/ca.crt`);
+        const identity = { mspId, credentials: certPem };
+        const signer = signers.newPrivateKeySigner(crypto.createPrivateKey(keyPem));
+
+        this.members = [];
+        for (let i = 0; i < Math.max(1, size); i++) {
+            const client = new grpc.Client(
+                peerEndpoint,
+                grpc.credentials.createSsl(tlsRoot, undefined, undefined, {
+                    'grpc.ssl_target_name_override': hostAlias,
+                    'grpc.default_authority': hostAlias,
+                    'grpc.use_local_subchannel_pool': 1,
+                })
+            );
+            const gateway = connect({ identity, signer, hash: hash.sha256, client });
+            const network = gateway.getNetwork(channel);
+            this.members.push({ client, gateway, network, contract: network.getContract(chaincode) });
+        }
+        this.next = 0;
+
+        const pick = () => this.pick().contract;
+        this.contract = {
+            evaluateTransaction: (...args) => pick().evaluateTransaction(...args),
+            submitTransaction: (...args) => pick().submitTransaction(...args),
+            newProposal: (...args) => pick().newProposal(...args),
+        };
+        // Event streams are long-lived; one member carries them.
+        this.network = this.members[0].network;
+    }
+
+    pick() {
+        const m = this.members[this.next];
+        this.next = (this.next + 1) % this.members.length;
+        return m;
+    }
+
+    close() {
+        for (const { gateway, client } of this.members) {
+            gateway.close();
+            client.close();
+        }
+    }
+}
+
+module.exports = { FabricPool };
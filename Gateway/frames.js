@@ -0,0 +1,109 @@
+// Packed sensor frames, as the mobile nodes advertise them (the wire format
+// is mylib/ble_frame.h): a base node can post the frames it heard as they
+// are, concatenated, to POST /reading/frames instead of one JSON body each.
+//
+// The native decoder (native/frames.c, built by node-gyp from binding.gyp)
+// is used when it is built; otherwise the JavaScript one below, which reads
+// each field through a DataView. Either way:
+//
+//   decode(buf)        -> { count, skipped, uuid: Uint32Array, ... }
+//   decodeObjects(buf) -> [{ uuid, timestamp, pressure, ... }, ...]
+//
+// decode() is columnar: one typed array per field over a single
+// ArrayBuffer, no object per frame. decodeObjects() gives the same objects
+// a JSON POST /reading parses to (with numbers rather than strings), ready
+// for validateIncoming; with the native decoder they are built from its
+// columns. Frames without the prefix are skipped and trailing bytes
+// ignored.
+
+const FRAME_SIZE = 21;
+const PREFIX = 0xa3f9c2b7;
+
+// name, offset in the frame, DataView getter; uuid is handled apart.
+const FIELDS = [
+    ['timestamp', 8, 'getUint16'],
+    ['pressure', 10, 'getUint8'],
+    ['humidity', 11, 'getUint8'],
+    ['temperature', 12, 'getUint8'],
+    ['r', 13, 'getUint8'],
+    ['g', 14, 'getUint8'],
+    ['b', 15, 'getUint8'],
+    ['tvoc', 16, 'getUint16'],
+    ['accel_x', 18, 'getInt8'],
+    ['accel_y', 19, 'getInt8'],
+    ['accel_z', 20, 'getInt8'],
+];
+
+const uuidString = u => String.fromCharCode(u >>> 24, (u >>> 16) & 0xff, (u >>> 8) & 0xff, u & 0xff);
+
+function decodeJs(buf) {
+    const view = new DataView(buf.buffer, buf.byteOffset, buf.byteLength);
+    const frames = Math.floor(buf.length / FRAME_SIZE);
+    // Same layout as the native decoder: widest columns first.
+    const ab = new ArrayBuffer(frames * 17);
+    const cols = {
+        uuid: new Uint32Array(ab, 0, frames),
+        timestamp: new Uint16Array(ab, frames * 4, frames),
+        tvoc: new Uint16Array(ab, frames * 6, frames),
+    };
+    ['pressure', 'humidity', 'temperature', 'r', 'g', 'b'].forEach((name, i) => {
+        cols[name] = new Uint8Array(ab, frames * (8 + i), frames);
+    });
+    ['accel_x', 'accel_y', 'accel_z'].forEach((name, i) => {
+        cols[name] = new Int8Array(ab, frames * (14 + i), frames);
+    });
+
+    let n = 0;
+    for (let i = 0; i < frames; i++) {
+        const at = i * FRAME_SIZE;
+        if (view.getUint32(at) !== PREFIX) continue;
+        cols.uuid[n] = view.getUint32(at + 4);
+        for (const [name, offset, get] of FIELDS) cols[name][n] = view[get](at + offset, true);
+        n++;
+    }
+    const out = { count: n, skipped: frames - n };
+    for (const [name, col] of Object.entries(cols)) out[name] = col.subarray(0, n);
+    return out;
+}
+
+function decodeObjectsJs(buf) {
+    const view = new DataView(buf.buffer, buf.byteOffset, buf.byteLength);
+    const frames = Math.floor(buf.length / FRAME_SIZE);
+    const out = [];
+    for (let i = 0; i < frames; i++) {
+        const at = i * FRAME_SIZE;
+        if (view.getUint32(at) !== PREFIX) continue;
+        const r = { uuid: uuidString(view.getUint32(at + 4)) };
+        for (const [name, offset, get] of FIELDS) r[name] = view[get](at + offset, true);
+        out.push(r);
+    }
+    return out;
+}
+
+// One object literal, so every reading has the same shape.
+function objectsFrom(c) {
+    const out = new Array(c.count);
+    for (let i = 0; i < c.count; i++) {
+        out[i] = {
+            uuid: uuidString(c.uuid[i]), timestamp: c.timestamp[i],
+            pressure: c.pressure[i], humidity: c.humidity[i], temperature: c.temperature[i],
+            r: c.r[i], g: c.g[i], b: c.b[i], tvoc: c.tvoc[i],
+            accel_x: c.accel_x[i], accel_y: c.accel_y[i], accel_z: c.accel_z[i],
+        };
+    }
+    return out;
+}
+
+let native = null;
+try {
+    native = require('./build/Release/frames.node');
+} catch {
+    // Not built (no toolchain at install time); the JavaScript decoder does.
+}
+
+module.exports = {
+    FRAME_SIZE, uuidString, decodeJs, decodeObjectsJs,
+    native: native !== null,
+    decode: native ? native.decode : decodeJs,
+    decodeObjects: native ? buf => objectsFrom(native.decode(buf)) : decodeObjectsJs,
+};
@@ -1,86 +1,676 @@
 const express = require('express');
 const fs = require('fs');
-const crypto = require('crypto');
+const path = require('path');
 const grpc = require('@grpc/grpc-js');
-const { connect, signers, hash } = require('@hyperledger/fabric-gateway');
-
-const peerEndpoint = 'peer0.org1.example.com:7051';
-const certPem = fs.readFileSync('./keys/cert.pem');
-const keyPem = fs.readFileSync('./keys/key.pem');
-const tlsRoot = fs.readFileSync('./keys/ca.crt');
-
-const client = new grpc.Client(
-    peerEndpoint,
-    grpc.credentials.createSsl(tlsRoot, undefined, undefined, {
-        'grpc.ssl_target_name_override': 'peer0.org1.example.com',
-        'grpc.default_authority': 'peer0.org1.example.com',
+const { FabricPool } = require('./fabric');
+const { StandInLedger } = require('./standin');
+const { SubmitPipeline } = require('./pipeline');
+const { WriteAheadLog } = require('./wal');
+const { LatestCache } = require('./latest');
+const { StreamHub } = require('./stream');
+const { Mirror } = require('./mirror');
+const { Registry } = require('./metrics');
+const { log } = require('./log');
+const { validateIncoming, serializeReading } = require('./schema');
+const { AnchorStore } = require('./anchor');
+const { TokenBuckets, Governor } = require('./admission');
+const { FRAME_SIZE, decodeObjects } = require('./frames');
+
+// Set by cluster.js: this process is one of several behind the same port
+// and keeps its own log, checkpoint and connections; worker 0 also does
+// the work there must only be one of (mirror, compaction).
+const workerIndex = process.env.WORKER_INDEX;
+const leader = workerIndex === undefined || workerIndex === '0';
+const perWorkerDir = dir => workerIndex === undefined ? dir : path.join(dir, `worker-${workerIndex}`);
+const perWorkerFile = file => workerIndex === undefined ? file : `${file}.${workerIndex}`;
+
+// The ledger backend: anything with a contract (evaluateTransaction,
+// submitTransaction, newProposal), a network (getChaincodeEvents,
+// getBlockEvents) and close(). LEDGER_BACKEND=standin swaps the peer for
+// an in-process stand-in with configurable latency, for load tests.
+const pool = process.env.LEDGER_BACKEND === 'standin'
+    ? new StandInLedger({
+        endorseMs: Number(process.env.STANDIN_ENDORSE_MS || 20),
+        commitMs: Number(process.env.STANDIN_COMMIT_MS || 500),
+        blockMs: Number(process.env.STANDIN_BLOCK_MS || 250),
+        jitter: Number(process.env.STANDIN_JITTER || 0.2),
     })
-);
+    : new FabricPool(Number(process.env.GRPC_POOL_SIZE || 2));
+const network = pool.network;
+const contract = pool.contract;
+
+const utf8 = new TextDecoder();
+
+// Wraps a result without copying so it can be sent to the client as is.
+const asBuffer = bytes => Buffer.from(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+
+// GET /metrics. Route latency is recorded by the middleware below; the
+// pipeline reports its stages and failures; depths and counts are read at
+// scrape time.
+const metrics = new Registry();
+const httpDuration = metrics.histogram('gateway_http_request_duration_seconds',
+    'HTTP request latency by route', ['method', 'route', 'status']);
+const fabricStage = metrics.histogram('gateway_fabric_stage_duration_seconds',
+    'CreateReadings latency per stage: queue wait, endorse, submit, commit', ['stage']);
+const fabricErrors = metrics.counter('gateway_fabric_errors_total',
+    'Failed Fabric calls by stage and gRPC status (TX_<code> for invalid transactions)', ['stage', 'code']);
+
+const grpcStatusNames = Object.fromEntries(Object.entries(grpc.status).map(([name, code]) => [code, name]));
+const errorStages = {
+    EndorseError: 'endorse', SubmitError: 'submit', CommitStatusError: 'commit', CommitError: 'commit',
+};
+
+// Label for a failed call: the gRPC status name, or TX_<validation code>
+// when the transaction committed invalid.
+function errorCode(err) {
+    if (err.txValidationCode !== undefined) return `TX_${err.txValidationCode}`;
+    if (err.name === 'CommitError') return `TX_${err.code}`;
+    return typeof err.code === 'number' ? grpcStatusNames[err.code] ?? String(err.code) : 'UNKNOWN';
+}
+
+function countError(err) {
+    fabricErrors.inc([errorStages[err.name] ?? 'evaluate', errorCode(err)]);
+}
+
+// Counts and logs a failed Fabric call and answers 500.
+function fail(res, err) {
+    countError(err);
+    log.error(err.message, { route: res.req.route?.path, code: errorCode(err) });
+    res.status(500).json({ error: err.message });
+}
+
+// POST /reading bodies are acknowledged once they are fsynced to the
+// write-ahead log (wal.js). drainLog() reads the log back into the pipeline
+// (pipeline.js), which coalesces it into CreateReadings transactions; the
+// log is checkpointed as they commit. While the peer is down, readings pile
+// up on disk, up to WAL_MAX_DEPTH, and are sent once it is back.
+const wal = new WriteAheadLog(perWorkerDir(process.env.WAL_DIR || './wal'), {
+    segmentBytes: Number(process.env.WAL_SEGMENT_BYTES || 16 << 20),
+});
+const WAL_MAX_DEPTH = Number(process.env.WAL_MAX_DEPTH || 5000000);
+
+// Readings the pipeline gives up on (rejected by CreateReadings, or failed
+// BATCH_MAX_ATTEMPTS times for a reason other than the network) are
+// appended to DEAD_LETTER_FILE as JSON lines, { ts, reason, reading }, and
+// only then checkpointed out of the log. Post them again once the cause
+// is fixed.
+const deadLetterFile = perWorkerFile(process.env.DEAD_LETTER_FILE || './dead-letter.jsonl');
+
+function deadLetter(entries, reasons) {
+    const ts = Date.now();
+    const lines = entries.map((e, i) => JSON.stringify({ ts, reason: reasons[i], reading: e.item }));
+    fs.promises.appendFile(deadLetterFile, lines.join('\n') + '\n').then(() => {
+        wal.commit(entries.map(e => e.tag));
+        drainLog();
+    }, err => {
+        // Left uncommitted, so they are sent again after a restart.
+        log.error('dead letter write failed', { readings: entries.length, error: err.message });
+    });
+}
+
+const pipeline = new SubmitPipeline(contract, {
+    maxItems: Number(process.env.BATCH_MAX_ITEMS || 50),
+    lingerMs: Number(process.env.BATCH_LINGER_MS || 20),
+    maxInFlight: Number(process.env.MAX_IN_FLIGHT || 8),
+    maxQueued: Number(process.env.MAX_QUEUED || 10000),
+    maxAttempts: Number(process.env.BATCH_MAX_ATTEMPTS || 5),
+    onCommitted: lsns => {
+        wal.commit(lsns);
+        drainLog();
+    },
+    onDeadLetter: deadLetter,
+    onStage: (stage, ms) => fabricStage.observe([stage], ms / 1000),
+    onError: (stage, err) => fabricErrors.inc([stage, errorCode(err)]),
+});
+
+let draining = false;
+let drainAgain = false;
+
+async function drainLog() {
+    if (draining) {
+        drainAgain = true;
+        return;
+    }
+    draining = true;
+    try {
+        do {
+            drainAgain = false;
+            while (pipeline.room() > 0) {
+                const records = await wal.read(Math.min(pipeline.room(), 1000));
+                if (records.length === 0) break;
+                for (const { lsn, payload } of records) {
+                    pipeline.add(JSON.parse(payload), lsn);
+                }
+            }
+        } while (drainAgain);
+    } catch (err) {
+        log.error('wal read failed', { error: err.message });
+    } finally {
+        draining = false;
+    }
+}
+
+wal.on('durable', drainLog);
 
-const identity = { mspId: 'Org1MSP', credentials: certPem };
-const signer = signers.newPrivateKeySigner(crypto.createPrivateKey(keyPem));
+// LEDGER_MODE=anchor keeps readings off-chain and commits one Merkle root
+// per ANCHOR_WINDOW_MS instead of one key per reading.
+const anchorMode = process.env.LEDGER_MODE === 'anchor';
+const anchors = new AnchorStore(process.env.ANCHOR_DIR || './anchor-store', {
+    anchor: (batchId, root, from, to, count) => contract.submitTransaction(
+        'AnchorBatch', batchId, root, String(from), String(to), String(count)),
+    getAnchor: async batchId => JSON.parse(utf8.decode(
+        await contract.evaluateTransaction('GetAnchor', batchId))),
+}, {
+    windowMs: Number(process.env.ANCHOR_WINDOW_MS || 60000),
+    maxLeaves: Number(process.env.ANCHOR_MAX_LEAVES || 10000),
+});
+
+// Latest reading per device, fed by the chaincode's "latest" events.
+const latest = new LatestCache();
+latest.follow(network, 'sensorCC', perWorkerFile(process.env.EVENT_CHECKPOINT || './event-checkpoint.json'));
+
+// Pushes the cache's updates to /stream subscribers.
+const hub = new StreamHub(latest, {
+    maxBufferedBytes: Number(process.env.STREAM_MAX_BUFFERED_BYTES || 256 << 10),
+});
 
-const gateway = connect({ identity, signer, hash: hash.sha256, client });
-const network = gateway.getNetwork('sensordata');
-const contract = network.getContract('sensorCC');
+// Readings copied from committed blocks into SQLite, for history queries
+// that do not touch the peer.
+const mirror = new Mirror(process.env.MIRROR_DB || './mirror.db', 'sensorCC');
+if (leader) mirror.follow(network);
+
+// Admission control for POST /reading (admission.js). Rates are readings
+// per second. A source is a client address: one base node forwarding all
+// the devices it hears, so its allowance is the sum of theirs. A device
+// reports every few seconds, and its burst covers a base node's backlog.
+//
+// The buckets live in each process. In cluster mode a client's connections
+// are spread over the workers and none of them sees the others' buckets,
+// so each worker gets its share of every rate and burst: the gateway as a
+// whole never admits more than configured. A client that keeps all its
+// requests on one connection gets only that worker's share. A burst is
+// never cut below one request's worth (a full batch for a source), or
+// that request could never be admitted.
+const READING_MAX_BYTES = Number(process.env.READING_MAX_BYTES || 1024);
+const FRAMES_MAX = Number(process.env.FRAMES_MAX || 256);
+const workerShare = workerIndex === undefined ? 1 : 1 / Number(process.env.GATEWAY_WORKERS || 1);
+const sources = new TokenBuckets({
+    rate: Number(process.env.SOURCE_RATE || 500) * workerShare,
+    burst: Math.max(FRAMES_MAX, Number(process.env.SOURCE_BURST || 5000) * workerShare),
+});
+const devices = new TokenBuckets({
+    rate: Number(process.env.DEVICE_RATE || 1) * workerShare,
+    burst: Math.max(1, Number(process.env.DEVICE_BURST || 30) * workerShare),
+});
+const ingress = new Governor(Number(process.env.INGRESS_CONCURRENCY || 1024));
+const shed = { source: 0, size: 0, concurrency: 0, device: 0, backlog: 0 };
+setInterval(() => {
+    const now = performance.now();
+    sources.sweep(now);
+    devices.sweep(now);
+}, 10000).unref();
+
+function shedReading(res, reason, status, retryAfter, error) {
+    shed[reason]++;
+    log.sample('reading shed', { reason, source: res.req.socket.remoteAddress });
+    if (retryAfter > 0) res.set('Retry-After', String(Math.ceil(retryAfter)));
+    res.status(status).json({ error });
+}
 
 const app = express();
-app.use(express.json());
+app.use((req, res, next) => {
+    const started = process.hrtime.bigint();
+    res.on('finish', () => {
+        // Streams last as long as the subscriber stays; not a latency.
+        if (req.route?.path === '/stream') return;
+        httpDuration.observe([req.method, req.route?.path ?? 'unmatched', res.statusCode],
+            Number(process.hrtime.bigint() - started) / 1e9);
+    });
+    next();
+});
+// Ahead of the body parser, so a shed request is never parsed. readings()
+// is what a body of the given length costs its source.
+function admit(maxBytes, readings) {
+    return (req, res, next) => {
+        const length = Number(req.headers['content-length']);
+        const wait = sources.take(req.socket.remoteAddress, readings(length));
+        if (wait > 0) return shedReading(res, 'source', 429, wait, 'too many readings from this source');
+        if (length > maxBytes) return shedReading(res, 'size', 413, 0, `the body is at most ${maxBytes} bytes`);
+        if (!ingress.enter()) return shedReading(res, 'concurrency', 503, 1, 'too many readings in progress');
+        res.on('close', () => ingress.leave());
+        next();
+    };
+}
+app.post('/reading', admit(READING_MAX_BYTES, () => 1));
+app.post('/reading/frames', admit(FRAMES_MAX * FRAME_SIZE, length => Math.ceil(length / FRAME_SIZE) || 1));
+app.use(express.json({ limit: '16kb' }));
 
+// Served from the event-fed cache; the peer is only asked (GetLatest reads
+// the latest~uuid pointer) for a device not seen since startup. The pointer
+// is last writer wins on the ledger, but the cache keeps the newest reading
+// by (timestamp, seq), so this never goes backwards. The ETag is the
+// reading's timestamp and seq, so unchanged polls get a 304.
 app.get('/device/:uuid', async (req, res) => {
+    let entry = latest.get(req.params.uuid);
+    if (!entry) {
+        try {
+            const resultBytes = await contract.evaluateTransaction('GetLatest', req.params.uuid);
+            entry = latest.put(JSON.parse(utf8.decode(resultBytes)));
+        } catch (err) {
+            return fail(res, err);
+        }
+    }
+    res.set('ETag', entry.etag);
+    if (req.fresh) return res.status(304).end();
+    res.type('application/json').send(entry.body);
+});
+
+// GET /device/AB12/readings?from=&to=&limit=&bookmark=[&format=binary]
+// One page of a time window; pass the returned bookmark back for the next.
+// The chaincode already renders the page, so its bytes are sent as they are.
+app.get('/device/:uuid/readings', async (req, res) => {
+    const { from = '0', to = '18446744073709551615', limit = '100', bookmark = '' } = req.query;
+    if (![from, to, limit].every(v => /^\d+$/.test(v))) {
+        return res.status(400).json({ error: 'from, to and limit must be integers' });
+    }
+    const binary = req.query.format === 'binary';
     try {
-        const resultBytes = await contract.evaluateTransaction('QueryDevice', req.params.uuid);
-        let jsonStr = resultBytes.toString();
+        const resultBytes = await contract.evaluateTransaction(
+            binary ? 'QueryDeviceRaw' : 'QueryDeviceRange',
+            req.params.uuid, from, to, limit, String(bookmark));
+        res.type(binary ? 'application/octet-stream' : 'application/json')
+            .send(asBuffer(resultBytes));
+    } catch (err) {
+        fail(res, err);
+    }
+});
+
+// Window checks shared by the mirror routes.
+function windowQuery(req, res, extra = []) {
+    const q = { from: '0', to: String(Number.MAX_SAFE_INTEGER), ...req.query };
+    if (![q.from, q.to, ...extra.map(k => q[k])].every(v => /^\d+$/.test(v))) {
+        res.status(400).json({ error: ['from', 'to', ...extra].join(', ') + ' must be integers' });
+        return null;
+    }
+    return q;
+}
+
+// GET /device/AB12/history?from=&to=&limit= -> readings from the local mirror
+app.get('/device/:uuid/history', (req, res) => {
+    const q = windowQuery(req, res, ['limit']);
+    if (!q) return;
+    res.json(mirror.range(req.params.uuid, Number(q.from), Number(q.to), Number(q.limit ?? 1000)));
+});
 
-        if (/^\d+,/.test(jsonStr)) {
-            const byteArray = Uint8Array.from(
-                jsonStr.split(',').map(n => parseInt(n, 10)));
-            jsonStr = Buffer.from(byteArray).toString('utf8');
+// GET /device/AB12/history/downsample?from=&to=&bucket=<ms> -> count and
+// avg/min/max of every channel per bucket
+app.get('/device/:uuid/history/downsample', (req, res) => {
+    const q = windowQuery(req, res, ['bucket']);
+    if (!q) return;
+    const bucket = Number(q.bucket);
+    if (!Number.isSafeInteger(bucket) || bucket <= 0) {
+        return res.status(400).json({ error: 'bucket must be a positive integer' });
+    }
+    res.json(mirror.downsample(req.params.uuid, Number(q.from), Number(q.to), bucket));
+});
+
+// GET /device/AB12/history/aggregate?from=&to= -> the same over the window
+app.get('/device/:uuid/history/aggregate', (req, res) => {
+    const q = windowQuery(req, res);
+    if (!q) return;
+    res.json(mirror.aggregate(req.params.uuid, Number(q.from), Number(q.to)));
+});
+
+// GET /device/AB12/history/verify?from=&to= -> compare the mirror with the
+// ledger over the window
+app.get('/device/:uuid/history/verify', async (req, res) => {
+    const q = windowQuery(req, res);
+    if (!q) return;
+    try {
+        res.json(await mirror.verify(contract, req.params.uuid, q.from, q.to));
+    } catch (err) {
+        fail(res, err);
+    }
+});
+
+// GET /device/AB12/rollups?resolution=hour|day&from=&to=
+app.get('/device/:uuid/rollups', async (req, res) => {
+    const { resolution = 'hour', from = '0', to = '18446744073709551615' } = req.query;
+    if (![from, to].every(v => /^\d+$/.test(v))) {
+        return res.status(400).json({ error: 'from and to must be integers' });
+    }
+    try {
+        const resultBytes = await contract.evaluateTransaction(
+            'QueryRollups', req.params.uuid, String(resolution), from, to);
+        res.type('application/json').send(asBuffer(resultBytes));
+    } catch (err) {
+        fail(res, err);
+    }
+});
+
+// GET /device/AB12/shipment -> MKT and minutes out of range: the compacted
+// accumulators plus the readings since (pending; partial if more than a
+// page of them is waiting for CompactDevice)
+app.get('/device/:uuid/shipment', async (req, res) => {
+    try {
+        const resultBytes = await contract.evaluateTransaction('GetShipmentStatus', req.params.uuid);
+        res.type('application/json').send(asBuffer(resultBytes));
+    } catch (err) {
+        fail(res, err);
+    }
+});
+
+// POST /device/AB12/shipment/reset -> start a new shipment for the device
+app.post('/device/:uuid/shipment/reset', async (req, res) => {
+    try {
+        await contract.submitTransaction('ResetShipment', req.params.uuid);
+        res.json({ status: 'committed' });
+    } catch (err) {
+        fail(res, err);
+    }
+});
+
+// POST /device/AB12/prune?before=<ms> -> delete expired raw readings in
+// bounded PruneDevice transactions, each resuming at the bookmark of the
+// one before, until the window is done; kept counts expired readings the
+// retention policy still holds on to (not folded into rollups yet)
+app.post('/device/:uuid/prune', async (req, res) => {
+    const { before = String(Date.now()) } = req.query;
+    if (!/^\d+$/.test(before)) {
+        return res.status(400).json({ error: 'before must be an integer' });
+    }
+    try {
+        let deleted = 0;
+        let kept = 0;
+        let bookmark = '';
+        let more = true;
+        while (more) {
+            const resultBytes = await contract.submitTransaction(
+                'PruneDevice', req.params.uuid, before, '1000', bookmark);
+            const result = JSON.parse(utf8.decode(resultBytes));
+            deleted += result.deleted;
+            kept += result.kept;
+            ({ bookmark, more } = result);
         }
-        // console.log(jsonStr);
-        const readings = JSON.parse(jsonStr);
-        res.json(readings[readings.length - 1]);
+        res.json({ status: 'committed', deleted, kept });
     } catch (err) {
-        console.error(err);
-        res.status(500).json({ error: err.message });
+        fail(res, err);
     }
 });
 
-app.post('/reading', async (req, res) => {
-    const r = req.body;
-    const timestamp = new Date().getTime();
-    r.timestamp = timestamp;
-    console.log(r);
-
-    const output = Object.fromEntries(
-        Object.entries(r).map(([key, val]) => [
-            key,
-            (typeof val === 'string' && val.trim() !== '' && !isNaN(val))
-                ? Number(val)
-                : val
-        ])
-    );
-    console.log(JSON.stringify(output));
+// GET /excursions?uuid=AB12|all&from=&to= -> every out-of-spec reading
+app.get('/excursions', async (req, res) => {
+    const { uuid = 'all', from = '0', to = '18446744073709551615' } = req.query;
+    if (![from, to].every(v => /^\d+$/.test(v))) {
+        return res.status(400).json({ error: 'from and to must be integers' });
+    }
+    try {
+        const resultBytes = await contract.evaluateTransaction(
+            'QueryExcursions', String(uuid), from, to);
+        res.type('application/json').send(asBuffer(resultBytes));
+    } catch (err) {
+        fail(res, err);
+    }
+});
 
+// PUT /limits/AB12 or /limits/product:insulin
+// body: { "product": "insulin" } or { "channels": { "temperature": { "min": 2, "max": 8 } } }
+app.put('/limits/:scope', async (req, res) => {
     try {
-        await contract.submitTransaction(
-            'CreateReading',
-            r.uuid,
-            String(timestamp),
-            JSON.stringify(output)
-        );
+        await contract.submitTransaction('SetLimits', req.params.scope, JSON.stringify(req.body));
         res.json({ status: 'committed' });
     } catch (err) {
-        console.error(err);
+        fail(res, err);
+    }
+});
+
+// GET /devices?limit=&bookmark= -> one page of the device registry
+app.get('/devices', async (req, res) => {
+    const { limit = '100', bookmark = '' } = req.query;
+    if (!/^\d+$/.test(limit)) {
+        return res.status(400).json({ error: 'limit must be an integer' });
+    }
+    try {
+        const resultBytes = await contract.evaluateTransaction('ListDevices', limit, String(bookmark));
+        res.type('application/json').send(asBuffer(resultBytes));
+    } catch (err) {
+        fail(res, err);
+    }
+});
+
+// GET /latest?uuids=AB12,CD34 -> newest reading of each listed device,
+// from the cache; devices it does not hold yet are fetched in one
+// GetLatestMany
+app.get('/latest', async (req, res) => {
+    const uuids = String(req.query.uuids || '').split(',').filter(Boolean);
+    const misses = uuids.filter(uuid => !latest.get(uuid));
+    try {
+        if (misses.length > 0) {
+            const resultBytes = await contract.evaluateTransaction(
+                'GetLatestMany', JSON.stringify(misses));
+            JSON.parse(utf8.decode(resultBytes)).forEach(r => latest.put(r));
+        }
+        const bodies = uuids.map(uuid => latest.get(uuid)?.body).filter(Boolean);
+        res.type('application/json').send(`[${bodies.join(',')}]`);
+    } catch (err) {
+        fail(res, err);
+    }
+});
+
+// GET /stream?uuids=AB12,CD34 -> the latest reading of each device, then
+// every newer one as it commits, as server-sent events. The same URL
+// accepts a WebSocket upgrade (handled on the server below).
+app.get('/stream', (req, res) => {
+    const uuids = StreamHub.parseUuids(req.query.uuids);
+    if (!uuids) return res.status(400).json({ error: 'uuids must list 1 to 100 devices' });
+    hub.sse(req, res, uuids);
+});
+
+// The base forwards the node's advert counter as "timestamp"; keep it as
+// the sequence number that makes the ledger key unique, stamp the
+// reading with the gateway's time and render the bytes that are stored.
+function stamp(r) {
+    r.seq = r.timestamp;
+    r.timestamp = Date.now();
+    log.sample('reading', r);
+    return Buffer.from(serializeReading(r));
+}
+
+app.post('/reading', async (req, res) => {
+    // Checked here because the chaincode's verdict arrives after the ack;
+    // see schema.js.
+    const r = validateIncoming(req.body);
+    if (!r) return res.status(400).json({ error: validateIncoming.error });
+    const wait = devices.take(r.uuid);
+    if (wait > 0) return shedReading(res, 'device', 429, wait, `too many readings from ${r.uuid}`);
+    const body = stamp(r);
+
+    if (anchorMode) {
+        try {
+            const leaf = await anchors.append(body, r.timestamp);
+            res.json({ status: 'stored', leaf });
+        } catch (err) {
+            log.error('anchor append failed', { error: err.message });
+            res.status(500).json({ error: err.message });
+        }
+        return;
+    }
+
+    const depth = wal.stats().depth;
+    if (depth >= WAL_MAX_DEPTH) {
+        return shedReading(res, 'backlog', 429, pipeline.retryAfter(depth), 'write-ahead log full');
+    }
+    try {
+        const lsn = await wal.append(body);
+        res.status(202).json({ status: 'queued', lsn });
+    } catch (err) {
+        log.error('wal append failed', { error: err.message });
         res.status(500).json({ error: err.message });
     }
 });
 
-const PORT = 3000;
-app.listen(PORT, () => console.log(`REST API listening on :${PORT}`));
+// POST /reading/frames (application/octet-stream): up to FRAMES_MAX packed
+// sensor frames (frames.js), as the base node heard them. Each is handled
+// like a POST /reading body -> 202 with how many were queued, and how many
+// were skipped (no frame prefix), invalid or shed for their device's rate.
+app.post('/reading/frames', express.raw({ type: 'application/octet-stream', limit: FRAMES_MAX * FRAME_SIZE }),
+    async (req, res) => {
+        if (!Buffer.isBuffer(req.body) || req.body.length === 0 || req.body.length % FRAME_SIZE !== 0) {
+            return res.status(400).json({ error: `the body must be whole ${FRAME_SIZE}-byte frames` });
+        }
+        if (!anchorMode) {
+            const depth = wal.stats().depth;
+            if (depth >= WAL_MAX_DEPTH) {
+                return shedReading(res, 'backlog', 429, pipeline.retryAfter(depth), 'write-ahead log full');
+            }
+        }
+
+        const frames = decodeObjects(req.body);
+        const counts = { skipped: req.body.length / FRAME_SIZE - frames.length, invalid: 0, shed: 0 };
+        const readings = [];
+        for (const frame of frames) {
+            const r = validateIncoming(frame);
+            if (!r) {
+                counts.invalid++;
+            } else if (devices.take(r.uuid) > 0) {
+                counts.shed++;
+                shed.device++;
+            } else {
+                readings.push([stamp(r), r.timestamp]);
+            }
+        }
+
+        try {
+            if (anchorMode) {
+                for (const [body, ts] of readings) await anchors.append(body, ts);
+            } else {
+                // Appended together, so they share the log's fsyncs.
+                await Promise.all(readings.map(([body]) => wal.append(body)));
+            }
+        } catch (err) {
+            log.error(anchorMode ? 'anchor append failed' : 'wal append failed', { error: err.message });
+            return res.status(500).json({ error: err.message });
+        }
+        res.status(202).json({ status: 'queued', queued: readings.length, ...counts });
+    });
+
+// GET /pipeline -> write-ahead log depth, queue depth, in-flight
+// transactions, drain rate and per-stage latency (queue, endorse, submit,
+// commit) of the write path, readings shed at admission by reason, the
+// process's memory and, with the stand-in ledger, its counts
+app.get('/pipeline', (req, res) => {
+    res.json({
+        wal: wal.stats(), mirror: mirror.stats(), stream: hub.stats(), ...pipeline.stats(),
+        admission: { inProgress: ingress.active, sources: sources.size, devices: devices.size, shed },
+        memory: process.memoryUsage(), ledger: pool.stats?.(),
+    });
+});
+
+metrics.gauge('gateway_transactions_in_flight',
+    'CreateReadings transactions between endorsement and commit', () => pipeline.inFlight);
+metrics.gauge('gateway_queue_depth', 'Readings waiting, by queue', () => {
+    const w = wal.stats();
+    return [[['wal'], w.depth], [['wal_unread'], w.unread], [['pipeline'], pipeline.queue.length]];
+}, ['queue']);
+metrics.collectedCounter('gateway_readings_total', 'Readings through the write pipeline by outcome',
+    () => ['accepted', 'committed', 'rejected', 'retried', 'failed'].map(k => [[k], pipeline.counts[k]]), ['outcome']);
+metrics.collectedCounter('gateway_readings_shed_total', 'POST /reading requests refused at admission by reason',
+    () => Object.entries(shed).map(([reason, n]) => [[reason], n]), ['reason']);
+metrics.gauge('gateway_ingress_in_progress', 'POST /reading requests admitted and not yet answered',
+    () => ingress.active);
+metrics.gauge('gateway_stream_subscribers', 'Open /stream subscribers', () => hub.subscribers.size);
+metrics.collectedCounter('gateway_stream_evictions_total', 'Slow /stream subscribers disconnected',
+    () => hub.counts.evicted);
+metrics.collectedCounter('gateway_chaincode_events_total', 'Chaincode "latest" events applied to the cache',
+    () => latest.events);
+metrics.gauge('gateway_mirror_next_block', 'Next block the history mirror will apply',
+    () => Number(mirror.nextBlock()));
+metrics.collectedCounter('gateway_log_records_dropped_total', 'Log records dropped while output was behind',
+    () => log.counts.dropped);
+metrics.eventLoopLag();
+
+// GET /metrics -> Prometheus text format
+app.get('/metrics', (req, res) => {
+    res.type('text/plain; version=0.0.4').send(metrics.text());
+});
+
+// Rollups are folded by a separate CompactDevice transaction rather than on
+// every write; run it periodically for each device that reported since the
+// last round. Devices are learned from the latest events, so the one
+// process that compacts sees readings whichever worker took them.
+const activeDevices = new Set();
+const COMPACT_INTERVAL_MS = Number(process.env.COMPACT_INTERVAL_MS || 60000);
 
-process.on('SIGINT', () => {
-    gateway.close();
-    client.close();
+if (leader) latest.on('update', uuid => activeDevices.add(uuid));
+
+if (leader) setInterval(async () => {
+    const uuids = [...activeDevices];
+    activeDevices.clear();
+    for (const uuid of uuids) {
+        try {
+            let more = true;
+            while (more) {
+                const resultBytes = await contract.submitTransaction('CompactDevice', uuid, '1000');
+                more = JSON.parse(utf8.decode(resultBytes)).more;
+            }
+        } catch (err) {
+            countError(err);
+            log.error('CompactDevice failed', { uuid, error: err.message });
+            activeDevices.add(uuid);
+        }
+    }
+}, COMPACT_INTERVAL_MS).unref();
+
+// GET /anchor/proof/<leaf> -> the stored reading and its Merkle proof, ready
+// to hand to the chaincode's VerifyReading.
+app.get('/anchor/proof/:leaf', async (req, res) => {
+    try {
+        const p = await anchors.proof(req.params.leaf);
+        if (!p) return res.status(404).json({ error: 'unknown or not yet sealed leaf' });
+        res.json(p);
+    } catch (err) {
+        log.error('anchor proof failed', { leaf: req.params.leaf, error: err.message });
+        res.status(500).json({ error: err.message });
+    }
+});
+
+const PORT = Number(process.env.PORT || 3000);
+const SHUTDOWN_TIMEOUT_MS = Number(process.env.SHUTDOWN_TIMEOUT_MS || 30000);
+let server = null;
+
+(anchorMode ? anchors.init() : wal.open().then(drainLog)).then(() => {
+    server = app.listen(PORT, () => log.info('REST API listening', { port: PORT, worker: workerIndex }));
+    server.on('upgrade', (req, socket, head) => hub.upgrade(req, socket, head));
+});
+
+// Stops accepting requests, lets the CreateReadings batches in flight
+// finish and checkpoints the log. Readings still queued are in the log and
+// go out after the next start. In anchor mode the open window is sealed
+// and anchored instead.
+let shuttingDown = false;
+
+async function shutdown() {
+    if (shuttingDown) return;
+    shuttingDown = true;
+    setTimeout(() => {
+        log.error('shutdown timed out', { ms: SHUTDOWN_TIMEOUT_MS });
+        log.flush().then(() => process.exit(1));
+    }, SHUTDOWN_TIMEOUT_MS).unref();
+    server?.close();
+    hub.close();
+    if (anchorMode) {
+        await anchors.close().catch(err => log.error('anchor close failed', { error: err.message }));
+    } else {
+        await pipeline.drain();
+        await wal.close().catch(err => log.error('wal close failed', { error: err.message }));
+    }
+    pool.close();
+    await log.flush();
     process.exit();
+}
+
+process.on('SIGINT', shutdown);
+process.on('SIGTERM', shutdown);
+process.on('message', msg => {
+    if (msg === 'shutdown') shutdown();
 });
@@ -0,0 +1,79 @@
+// In-memory latest reading per device, kept current by the chaincode's
+// "latest" events instead of by querying the peer.
+//
+// Every CreateReading/CreateReadings transaction emits the new latest~uuid
+// values as one event. follow() listens for them through
+// network.getChaincodeEvents with a file checkpointer, so a reconnect or
+// restart resumes after the last event handled rather than missing or
+// replaying blocks. Devices that have not written since the gateway
+// started are filled from GetLatest on first request.
+//
+// The chaincode's latest~uuid is last writer wins, so a late or replayed
+// reading can arrive here (by event or from GetLatest) after a newer one.
+// put() keeps whichever is newer by (timestamp, seq), so what the cache
+// serves never goes backwards.
+//
+// Each entry keeps the rendered body and an ETag derived from the
+// reading's (timestamp, seq), so an unchanged poll costs a map lookup and
+// a 304. Every newer reading is also emitted as 'update' (uuid, entry)
+// for live subscribers (stream.js).
+
+const { EventEmitter } = require('events');
+const { checkpointers } = require('@hyperledger/fabric-gateway');
+const { serializeReading } = require('./schema');
+const { log } = require('./log');
+
+const utf8 = new TextDecoder();
+
+class LatestCache extends EventEmitter {
+    constructor() {
+        super();
+        this.entries = new Map();   // uuid -> { timestamp, seq, etag, body }
+        this.events = 0;
+    }
+
+    get(uuid) {
+        return this.entries.get(uuid);
+    }
+
+    // Stores r unless the cached reading is the same or newer by
+    // (timestamp, seq).
+    put(r) {
+        const prev = this.entries.get(r.uuid);
+        if (prev && (prev.timestamp > r.timestamp ||
+            (prev.timestamp === r.timestamp && prev.seq >= r.seq))) return prev;
+        const entry = {
+            timestamp: r.timestamp,
+            seq: r.seq,
+            etag: `"${r.timestamp}-${r.seq}"`,
+            body: Buffer.from(serializeReading(r)),
+        };
+        this.entries.set(r.uuid, entry);
+        this.emit('update', r.uuid, entry);
+        return entry;
+    }
+
+    async follow(network, chaincodeName, checkpointFile, retryMs = 5000) {
+        const checkpointer = await checkpointers.file(checkpointFile);
+        for (;;) {
+            let events;
+            try {
+                events = await network.getChaincodeEvents(chaincodeName, { checkpoint: checkpointer });
+                for await (const event of events) {
+                    if (event.eventName === 'latest') {
+                        JSON.parse(utf8.decode(event.payload)).forEach(r => this.put(r));
+                        this.events++;
+                    }
+                    await checkpointer.checkpointChaincodeEvent(event);
+                }
+            } catch (err) {
+                log.error('chaincode events failed', { error: err.message });
+            } finally {
+                events?.close();
+            }
+            await new Promise(resolve => setTimeout(resolve, retryMs));
+        }
+    }
+}
+
+module.exports = { LatestCache };
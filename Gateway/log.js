@@ -0,0 +1,76 @@
+// Structured logging off the request path.
+//
+// Each record is one JSON line ({ ts, level, msg, ...fields }). Lines are
+// buffered and written in one write per event-loop turn, through an fs
+// stream on fd 1 (or LOG_FILE) so the write happens on the thread pool;
+// process.stdout blocks on a pipe or terminal under Linux. While the
+// output is not keeping up, new records are dropped and counted instead of
+// piling up in memory. sample() keeps only a fraction LOG_SAMPLE_RATE of
+// its calls, for per-request detail that would otherwise cost more than
+// the request. Call flush() and wait for it before process.exit(), or the
+// records of the last turn are lost.
+
+const fs = require('fs');
+
+const MAX_BUFFERED = 1 << 20;
+
+class Logger {
+    constructor(stream, { sampleRate = 0.01 } = {}) {
+        this.stream = stream;
+        this.sampleRate = sampleRate;
+        this.buffer = [];
+        this.scheduled = false;
+        this.counts = { written: 0, dropped: 0, sampledOut: 0 };
+    }
+
+    info(msg, fields) {
+        this.write('info', msg, fields);
+    }
+
+    error(msg, fields) {
+        this.write('error', msg, fields);
+    }
+
+    sample(msg, fields) {
+        if (Math.random() >= this.sampleRate) {
+            this.counts.sampledOut++;
+            return;
+        }
+        this.write('debug', msg, fields);
+    }
+
+    write(level, msg, fields) {
+        if (this.stream.writableLength > MAX_BUFFERED) {
+            this.counts.dropped++;
+            return;
+        }
+        this.buffer.push(JSON.stringify({ ts: Date.now(), level, msg, ...fields }));
+        if (!this.scheduled) {
+            this.scheduled = true;
+            setImmediate(() => this.flush());
+        }
+    }
+
+    // Writes what is buffered; resolves once everything written so far has
+    // reached the stream's file.
+    flush() {
+        this.scheduled = false;
+        let lines = '';
+        if (this.buffer.length > 0) {
+            lines = this.buffer.join('\n') + '\n';
+            this.counts.written += this.buffer.length;
+            this.buffer = [];
+        } else if (this.stream.writableLength === 0) {
+            return Promise.resolve();
+        }
+        return new Promise(resolve => this.stream.write(lines, () => resolve()));
+    }
+}
+
+const log = new Logger(process.env.LOG_FILE
+    ? fs.createWriteStream(process.env.LOG_FILE, { flags: 'a' })
+    : fs.createWriteStream(null, { fd: 1, autoClose: false }), {
+    sampleRate: Number(process.env.LOG_SAMPLE_RATE ?? 0.01),
+});
+
+module.exports = { Logger, log };
@@ -0,0 +1,141 @@
+// Prometheus text-format metrics for GET /metrics.
+//
+// Just enough of a client library for the gateway: counters and
+// histograms keyed by label values, and gauges read from a callback at
+// scrape time so queue depths and in-flight counts are never stale. Label
+// sets are small and fixed (route patterns, stage names, gRPC status
+// names), so every series is a Map entry and recording is a lookup and an
+// add.
+
+const { monitorEventLoopDelay } = require('perf_hooks');
+
+// Seconds; from a cached read to a slow commit under load.
+const LATENCY_BUCKETS = [0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10];
+
+const escape = v => String(v).replace(/\\/g, '\\\\').replace(/"/g, '\\"').replace(/\n/g, '\\n');
+
+function labelText(names, values, extra = '') {
+    const parts = names.map((n, i) => `${n}="${escape(values[i])}"`);
+    if (extra) parts.push(extra);
+    return parts.length ? `{${parts.join(',')}}` : '';
+}
+
+class Counter {
+    constructor(name, help, labels = []) {
+        Object.assign(this, { name, help, labels, type: 'counter' });
+        this.series = new Map();    // joined label values -> { values, n }
+    }
+
+    inc(values = [], by = 1) {
+        const key = values.join('\0');
+        const s = this.series.get(key);
+        if (s) s.n += by;
+        else this.series.set(key, { values, n: by });
+    }
+
+    lines() {
+        return [...this.series.values()].map(s => `${this.name}${labelText(this.labels, s.values)} ${s.n}`);
+    }
+}
+
+class Histogram {
+    constructor(name, help, labels = [], buckets = LATENCY_BUCKETS) {
+        Object.assign(this, { name, help, labels, buckets, type: 'histogram' });
+        this.series = new Map();    // joined label values -> { values, counts, sum, n }
+    }
+
+    observe(values, v) {
+        const key = values.join('\0');
+        let s = this.series.get(key);
+        if (!s) {
+            s = { values, counts: new Float64Array(this.buckets.length), sum: 0, n: 0 };
+            this.series.set(key, s);
+        }
+        const i = this.buckets.findIndex(b => v <= b);
+        if (i >= 0) s.counts[i]++;
+        s.sum += v;
+        s.n++;
+    }
+
+    lines() {
+        const out = [];
+        for (const s of this.series.values()) {
+            let cumulative = 0;
+            this.buckets.forEach((b, i) => {
+                cumulative += s.counts[i];
+                out.push(`${this.name}_bucket${labelText(this.labels, s.values, `le="${b}"`)} ${cumulative}`);
+            });
+            out.push(`${this.name}_bucket${labelText(this.labels, s.values, 'le="+Inf"')} ${s.n}`);
+            out.push(`${this.name}_sum${labelText(this.labels, s.values)} ${s.sum}`);
+            out.push(`${this.name}_count${labelText(this.labels, s.values)} ${s.n}`);
+        }
+        return out;
+    }
+}
+
+// A gauge or counter whose samples come from collect() at scrape time, as
+// [[labelValues, value], ...] or a single number.
+class Collected {
+    constructor(name, help, type, labels, collect) {
+        Object.assign(this, { name, help, type, labels, collect });
+    }
+
+    lines() {
+        const v = this.collect();
+        const samples = typeof v === 'number' ? [[[], v]] : v;
+        return samples.map(([values, n]) => `${this.name}${labelText(this.labels, values)} ${n}`);
+    }
+}
+
+class Registry {
+    constructor() {
+        this.metrics = [];
+    }
+
+    counter(name, help, labels) {
+        return this.add(new Counter(name, help, labels));
+    }
+
+    histogram(name, help, labels, buckets) {
+        return this.add(new Histogram(name, help, labels, buckets));
+    }
+
+    gauge(name, help, collect, labels = []) {
+        return this.add(new Collected(name, help, 'gauge', labels, collect));
+    }
+
+    collectedCounter(name, help, collect, labels = []) {
+        return this.add(new Collected(name, help, 'counter', labels, collect));
+    }
+
+    add(metric) {
+        this.metrics.push(metric);
+        return metric;
+    }
+
+    // Event-loop delay over the interval since the previous scrape. The
+    // sampler's own timer period is not lag, so it is subtracted.
+    eventLoopLag(name = 'gateway_event_loop_lag_seconds', resolutionMs = 10) {
+        const h = monitorEventLoopDelay({ resolution: resolutionMs });
+        h.enable();
+        return this.add({
+            name, type: 'gauge', labels: ['quantile'],
+            help: 'Event-loop delay since the previous scrape',
+            lines() {
+                const q = [['0.5', h.percentile(50)], ['0.99', h.percentile(99)], ['1', h.max]];
+                h.reset();
+                return q.map(([p, ns]) => `${name}{quantile="${p}"} ${Math.max(0, (ns || 0) / 1e6 - resolutionMs) / 1000}`);
+            },
+        });
+    }
+
+    text() {
+        const out = [];
+        for (const m of this.metrics) {
+            out.push(`# HELP ${m.name} ${m.help}`, `# TYPE ${m.name} ${m.type}`, ...m.lines());
+        }
+        return out.join('\n') + '\n';
+    }
+}
+
+module.exports = { Registry, LATENCY_BUCKETS };
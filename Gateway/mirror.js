@@ -0,0 +1,191 @@
+// Local time-series mirror of the ledger's readings, for history and
+// analytics without touching the peer.
+//
+// follow() reads committed blocks from network.getBlockEvents and copies
+// every reading~ write of a valid sensorCC transaction into SQLite. The
+// table is WITHOUT ROWID with primary key (uuid, ts, seq), so each device's
+// readings sit together in time order and a window is one contiguous range
+// of the b-tree, like the chaincode's reading keys. Each block is applied
+// in one SQLite transaction together with its block number, so after a
+// restart the mirror resumes exactly where it stopped.
+//
+// Deletes (PruneDevice) are not mirrored: the mirror keeps the history the
+// ledger has summarised into rollups. verify() compares a window against
+// the ledger through QueryDeviceRaw.
+
+const Database = require('better-sqlite3');
+const { common, ledger, peer } = require('@hyperledger/fabric-protos');
+const { decodeValue } = require('./codec');
+const { log } = require('./log');
+
+const CHANNELS = ['pressure', 'humidity', 'temperature', 'r', 'g', 'b', 'tvoc',
+    'accel_x', 'accel_y', 'accel_z'];
+const COLUMNS = ['uuid', 'ts', 'seq', ...CHANNELS];
+
+class Mirror {
+    constructor(file, chaincodeName) {
+        this.chaincodeName = chaincodeName;
+        this.db = new Database(file);
+        this.db.pragma('journal_mode = WAL');
+        this.db.pragma('synchronous = NORMAL');
+        // In cluster mode every worker reads the file and worker 0 writes it.
+        this.db.pragma('busy_timeout = 5000');
+        this.db.exec(`
+            CREATE TABLE IF NOT EXISTS readings (
+                uuid TEXT NOT NULL, ts INTEGER NOT NULL, seq INTEGER NOT NULL,
+                pressure REAL, humidity REAL, temperature REAL,
+                r INTEGER, g INTEGER, b INTEGER, tvoc INTEGER,
+                accel_x INTEGER, accel_y INTEGER, accel_z INTEGER,
+                PRIMARY KEY (uuid, ts, seq)
+            ) WITHOUT ROWID;
+            CREATE TABLE IF NOT EXISTS sync (id INTEGER PRIMARY KEY CHECK (id = 0), block INTEGER NOT NULL);
+        `);
+
+        this.insert = this.db.prepare(`INSERT OR REPLACE INTO readings (${COLUMNS.join(', ')})
+            VALUES (${COLUMNS.map(c => '@' + c).join(', ')})`);
+        this.saveBlock = this.db.prepare('INSERT OR REPLACE INTO sync (id, block) VALUES (0, ?)');
+        this.loadBlock = this.db.prepare('SELECT block FROM sync WHERE id = 0');
+        this.rangeStmt = this.db.prepare(`SELECT ${COLUMNS.join(', ')} FROM readings
+            WHERE uuid = ? AND ts BETWEEN ? AND ? ORDER BY ts, seq LIMIT ?`);
+        this.aggregateStmt = this.db.prepare(`SELECT COUNT(*) AS count, MIN(ts) AS first_ts, MAX(ts) AS last_ts,
+            ${CHANNELS.map(c => `AVG(${c}) AS ${c}_avg, MIN(${c}) AS ${c}_min, MAX(${c}) AS ${c}_max`).join(', ')}
+            FROM readings WHERE uuid = ? AND ts BETWEEN ? AND ?`);
+        // better-sqlite3 binds a JS number as REAL, and ts / REAL would not
+        // truncate: every reading would be a bucket of its own.
+        this.downsampleStmt = this.db.prepare(`SELECT ts / CAST(@bucket AS INTEGER) * CAST(@bucket AS INTEGER) AS start,
+            COUNT(*) AS count,
+            ${CHANNELS.map(c => `AVG(${c}) AS ${c}_avg, MIN(${c}) AS ${c}_min, MAX(${c}) AS ${c}_max`).join(', ')}
+            FROM readings WHERE uuid = @uuid AND ts BETWEEN @from AND @to
+            GROUP BY start ORDER BY start`);
+
+        this.applyBlock = this.db.transaction((number, rows) => {
+            rows.forEach(row => this.insert.run(row));
+            this.saveBlock.run(number);
+        });
+        this.blocks = 0;
+        this.rows = 0;
+    }
+
+    // Number of the next block to read: one past the last one applied.
+    nextBlock() {
+        const row = this.loadBlock.get();
+        return row ? BigInt(row.block) + 1n : 0n;
+    }
+
+    async follow(network, retryMs = 5000) {
+        for (;;) {
+            let blocks;
+            try {
+                blocks = await network.getBlockEvents({ startBlock: this.nextBlock() });
+                for await (const block of blocks) {
+                    const number = Number(block.getHeader().getNumber());
+                    const rows = this.readingsOf(block);
+                    this.applyBlock(number, rows);
+                    this.blocks++;
+                    this.rows += rows.length;
+                }
+            } catch (err) {
+                log.error('mirror block events failed', { error: err.message });
+            } finally {
+                blocks?.close();
+            }
+            await new Promise(resolve => setTimeout(resolve, retryMs));
+        }
+    }
+
+    // Rows for every reading~ key written by a valid transaction of the
+    // chaincode in block.
+    readingsOf(block) {
+        const rows = [];
+        const flags = block.getMetadata().getMetadataList_asU8()[common.BlockMetadataIndex.TRANSACTIONS_FILTER];
+        block.getData().getDataList_asU8().forEach((envelopeBytes, i) => {
+            if (flags && flags[i] !== peer.TxValidationCode.VALID) return;
+
+            const payload = common.Payload.deserializeBinary(
+                common.Envelope.deserializeBinary(envelopeBytes).getPayload_asU8());
+            const header = common.ChannelHeader.deserializeBinary(
+                payload.getHeader().getChannelHeader_asU8());
+            if (header.getType() !== common.HeaderType.ENDORSER_TRANSACTION) return;
+
+            const tx = peer.Transaction.deserializeBinary(payload.getData_asU8());
+            for (const action of tx.getActionsList()) {
+                const endorsed = peer.ChaincodeActionPayload.deserializeBinary(action.getPayload_asU8()).getAction();
+                const response = peer.ProposalResponsePayload.deserializeBinary(
+                    endorsed.getProposalResponsePayload_asU8());
+                const results = peer.ChaincodeAction.deserializeBinary(response.getExtension_asU8()).getResults_asU8();
+                for (const ns of ledger.rwset.TxReadWriteSet.deserializeBinary(results).getNsRwsetList()) {
+                    if (ns.getNamespace() !== this.chaincodeName) continue;
+                    const kv = ledger.rwset.kvrwset.KVRWSet.deserializeBinary(ns.getRwset_asU8());
+                    for (const w of kv.getWritesList()) {
+                        if (w.getIsDelete() || !w.getKey().startsWith('\0reading\0')) continue;
+                        rows.push(toRow(decodeValue(w.getValue_asU8())));
+                    }
+                }
+            }
+        });
+        return rows;
+    }
+
+    range(uuid, from, to, limit) {
+        return this.rangeStmt.all(uuid, from, to, limit).map(fromRow);
+    }
+
+    aggregate(uuid, from, to) {
+        return this.aggregateStmt.get(uuid, from, to);
+    }
+
+    downsample(uuid, from, to, bucket) {
+        return this.downsampleStmt.all({ uuid, from, to, bucket });
+    }
+
+    // Walks [from, to] of uuid on the ledger and checks every reading is in
+    // the mirror with the same values.
+    async verify(contract, uuid, from, to) {
+        const report = { checked: 0, missing: 0, mismatched: 0, examples: [] };
+        const get = this.db.prepare(`SELECT ${COLUMNS.join(', ')} FROM readings
+            WHERE uuid = ? AND ts = ? AND seq = ?`);
+        let bookmark = '';
+        do {
+            const page = Buffer.from(await contract.evaluateTransaction(
+                'QueryDeviceRaw', uuid, String(from), String(to), '1000', bookmark));
+            let off = 4 + page.readUInt32BE(0);
+            bookmark = page.subarray(4, off).toString('utf8');
+            while (off < page.length) {
+                const len = page.readUInt32BE(off);
+                const onLedger = decodeValue(page.subarray(off + 4, off + 4 + len));
+                off += 4 + len;
+                report.checked++;
+
+                const row = get.get(onLedger.uuid, onLedger.timestamp, onLedger.seq);
+                let problem = null;
+                if (!row) {
+                    report.missing++;
+                    problem = 'missing';
+                } else if (COLUMNS.some(c => toRow(onLedger)[c] !== row[c])) {
+                    report.mismatched++;
+                    problem = 'mismatched';
+                }
+                if (problem && report.examples.length < 10) {
+                    report.examples.push({ problem, timestamp: onLedger.timestamp, seq: onLedger.seq });
+                }
+            }
+        } while (bookmark !== '');
+        return report;
+    }
+
+    stats() {
+        return { nextBlock: String(this.nextBlock()), blocks: this.blocks, rows: this.rows };
+    }
+}
+
+function toRow(r) {
+    const row = { uuid: r.uuid, ts: r.timestamp, seq: r.seq };
+    CHANNELS.forEach(c => { row[c] = r[c]; });
+    return row;
+}
+
+function fromRow({ ts, ...rest }) {
+    return { uuid: rest.uuid, timestamp: ts, ...rest };
+}
+
+module.exports = { Mirror };
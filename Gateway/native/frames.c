@@ -0,0 +1,175 @@
+/*
+ * Native decoder for packed sensor frames (POST /reading/frames), built
+ * from the firmware's wire-format header (mylib/ble_frame.h). frames.js
+ * loads it and falls back to a JavaScript decoder when it is not built.
+ *
+ *   decode(buf) -> { count, skipped, uuid: Uint32Array, timestamp: Uint16Array, ... }
+ *
+ * It takes every whole frame in buf, skips those without the frame prefix
+ * and ignores trailing bytes. Each field comes back as one typed array, all
+ * views of a single ArrayBuffer; uuid holds the four uuid bytes big-endian.
+ * Objects are built from these columns in JavaScript: creating them through
+ * N-API, a call per property, is slower than the DataView decoder.
+ */
+
+#include <node_api.h>
+#include <string.h>
+#include "ble_frame.h"
+
+/* Fields are read in host order; the wire is little-endian. */
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "frames.c assumes a little-endian host"
+#endif
+
+#define CHECK(call)                          \
+    do                                       \
+    {                                        \
+        if ((call) != napi_ok)               \
+        {                                    \
+            return NULL;                     \
+        }                                    \
+    } while (0)
+
+enum field
+{
+    F_UUID,
+    F_TIMESTAMP,
+    F_PRESSURE,
+    F_HUMIDITY,
+    F_TEMPERATURE,
+    F_R,
+    F_G,
+    F_B,
+    F_TVOC,
+    F_ACCEL_X,
+    F_ACCEL_Y,
+    F_ACCEL_Z,
+    F_COUNT
+};
+
+static const char *const field_names[F_COUNT] = {
+    "uuid", "timestamp", "pressure", "humidity", "temperature",
+    "r", "g", "b", "tvoc", "accel_x", "accel_y", "accel_z",
+};
+
+/* Copies out the frame at p; 0 if it does not carry the frame prefix. */
+static inline int read_frame(const uint8_t *p, struct ble_frame *f)
+{
+    memcpy(f, p, BLE_FRAME_SIZE);
+    return memcmp(f->prefix, ble_frame_prefix, sizeof(ble_frame_prefix)) == 0;
+}
+
+static inline uint32_t uuid_value(const struct ble_frame *f)
+{
+    return (uint32_t)f->uuid[0] << 24 | (uint32_t)f->uuid[1] << 16 | (uint32_t)f->uuid[2] << 8 | f->uuid[3];
+}
+
+static napi_value get_frames(napi_env env, napi_callback_info info, const uint8_t **data, size_t *count)
+{
+    size_t argc = 1;
+    napi_value arg;
+    bool is_buffer;
+    void *bytes;
+    size_t length;
+
+    CHECK(napi_get_cb_info(env, info, &argc, &arg, NULL, NULL));
+    CHECK(napi_is_buffer(env, arg, &is_buffer));
+    if (argc < 1 || !is_buffer)
+    {
+        napi_throw_type_error(env, NULL, "expected a Buffer");
+        return NULL;
+    }
+    CHECK(napi_get_buffer_info(env, arg, &bytes, &length));
+    *data = bytes;
+    *count = length / BLE_FRAME_SIZE;
+    return arg;
+}
+
+static napi_status set_view(napi_env env, napi_value out, napi_value ab, enum field field,
+                            napi_typedarray_type type, size_t offset, size_t count)
+{
+    napi_value view;
+    napi_status status = napi_create_typedarray(env, type, count, ab, offset, &view);
+
+    if (status != napi_ok)
+    {
+        return status;
+    }
+    return napi_set_named_property(env, out, field_names[field], view);
+}
+
+static napi_value decode(napi_env env, napi_callback_info info)
+{
+    const uint8_t *data;
+    size_t frames;
+    if (get_frames(env, info, &data, &frames) == NULL)
+    {
+        return NULL;
+    }
+
+    /* Columns by width, widest first, so every view is aligned:
+     * uuid (4), timestamp and tvoc (2), then the nine one-byte fields. */
+    napi_value ab;
+    uint8_t *base;
+    CHECK(napi_create_arraybuffer(env, frames * 17, (void **)&base, &ab));
+    uint32_t *uuid = (uint32_t *)base;
+    uint16_t *timestamp = (uint16_t *)(base + frames * 4);
+    uint16_t *tvoc = (uint16_t *)(base + frames * 6);
+    uint8_t *bytes = base + frames * 8;
+
+    size_t n = 0;
+    struct ble_frame f;
+    for (size_t i = 0; i < frames; i++)
+    {
+        if (!read_frame(data + i * BLE_FRAME_SIZE, &f))
+        {
+            continue;
+        }
+        uuid[n] = uuid_value(&f);
+        timestamp[n] = f.timestamp;
+        tvoc[n] = f.tvoc;
+        bytes[0 * frames + n] = f.pressure;
+        bytes[1 * frames + n] = f.humidity;
+        bytes[2 * frames + n] = f.temperature;
+        bytes[3 * frames + n] = f.r;
+        bytes[4 * frames + n] = f.g;
+        bytes[5 * frames + n] = f.b;
+        bytes[6 * frames + n] = (uint8_t)f.accel_x;
+        bytes[7 * frames + n] = (uint8_t)f.accel_y;
+        bytes[8 * frames + n] = (uint8_t)f.accel_z;
+        n++;
+    }
+
+    napi_value out, value;
+    CHECK(napi_create_object(env, &out));
+    CHECK(napi_create_uint32(env, (uint32_t)n, &value));
+    CHECK(napi_set_named_property(env, out, "count", value));
+    CHECK(napi_create_uint32(env, (uint32_t)(frames - n), &value));
+    CHECK(napi_set_named_property(env, out, "skipped", value));
+
+    size_t one = frames * 8;
+    CHECK(set_view(env, out, ab, F_UUID, napi_uint32_array, 0, n));
+    CHECK(set_view(env, out, ab, F_TIMESTAMP, napi_uint16_array, frames * 4, n));
+    CHECK(set_view(env, out, ab, F_TVOC, napi_uint16_array, frames * 6, n));
+    CHECK(set_view(env, out, ab, F_PRESSURE, napi_uint8_array, one + 0 * frames, n));
+    CHECK(set_view(env, out, ab, F_HUMIDITY, napi_uint8_array, one + 1 * frames, n));
+    CHECK(set_view(env, out, ab, F_TEMPERATURE, napi_uint8_array, one + 2 * frames, n));
+    CHECK(set_view(env, out, ab, F_R, napi_uint8_array, one + 3 * frames, n));
+    CHECK(set_view(env, out, ab, F_G, napi_uint8_array, one + 4 * frames, n));
+    CHECK(set_view(env, out, ab, F_B, napi_uint8_array, one + 5 * frames, n));
+    CHECK(set_view(env, out, ab, F_ACCEL_X, napi_int8_array, one + 6 * frames, n));
+    CHECK(set_view(env, out, ab, F_ACCEL_Y, napi_int8_array, one + 7 * frames, n));
+    CHECK(set_view(env, out, ab, F_ACCEL_Z, napi_int8_array, one + 8 * frames, n));
+    return out;
+}
+
+static napi_value init(napi_env env, napi_value exports)
+{
+    napi_value fn;
+
+    CHECK(napi_create_function(env, "decode", NAPI_AUTO_LENGTH, decode, NULL, &fn));
+    CHECK(napi_set_named_property(env, exports, "decode", fn));
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,303 @@
+// Write pipeline for POST /reading.
+//
+// Readings are acknowledged as soon as they are queued. Behind the queue,
+// batches of up to maxItems (or whatever arrived within lingerMs) become
+// CreateReadings transactions, with at most maxInFlight of them between
+// endorsement and commit at any time:
+//
+//   queue -> endorse -> submit to orderer -> commit status
+//
+// This is contract.submitAsync() split into its steps so each one can be
+// timed. Endorsement runs concurrently, but batches go to the orderer in
+// queue order, so latest~uuid does not move backwards (short of a retried
+// batch overtaking a newer one for the same device). A batch
+// that fails to endorse, submit or commit goes back to the front of the
+// queue and is retried with backoff; the writes are blind and keyed by
+// (uuid, ts, seq), so a retry that lands twice rewrites the same bytes.
+//
+// Failures that say nothing about the batch (peer or orderer unreachable,
+// timeouts, an MVCC conflict) are retried for as long as they last; the
+// readings are safe in the write-ahead log meanwhile. Any other failure
+// counts as an attempt against every reading in the batch, and the
+// readings are then sent one per transaction, so a single bad one cannot
+// hold up the rest. A reading that has failed maxAttempts times, or that
+// CreateReadings rejects, is handed to onDeadLetter with the reason.
+//
+// When the queue is full, add() throws an error carrying retryAfter, an
+// estimate in seconds of how long the backlog takes to drain. Each entry
+// may carry a tag (the write-ahead log's lsn); onCommitted gets the tags of
+// the readings that reach the ledger and onDeadLetter the entries given up
+// on. onStage and onError report each stage's latency and each failure
+// (with the stage it happened in) to the metrics.
+
+const { log } = require('./log');
+
+const utf8 = new TextDecoder();
+const SAMPLES = 1024;
+
+// gRPC status codes that mean the call never got a verdict.
+const TRANSIENT_GRPC = new Set([
+    1,  // CANCELLED
+    4,  // DEADLINE_EXCEEDED
+    8,  // RESOURCE_EXHAUSTED
+    14, // UNAVAILABLE
+]);
+// Validation codes of a transaction that lost a race, not a bad one.
+const TRANSIENT_TX = new Set([
+    11, // MVCC_READ_CONFLICT
+    12, // PHANTOM_READ_CONFLICT
+]);
+
+function isTransient(err) {
+    if (err.txValidationCode !== undefined) return TRANSIENT_TX.has(err.txValidationCode);
+    return TRANSIENT_GRPC.has(err.code);
+}
+
+// Latency of one stage over its last SAMPLES observations, in ms.
+class StageStats {
+    constructor() {
+        this.samples = new Float64Array(SAMPLES);
+        this.n = 0;
+        this.max = 0;
+    }
+
+    record(ms) {
+        this.samples[this.n++ % SAMPLES] = ms;
+        if (ms > this.max) this.max = ms;
+    }
+
+    summary() {
+        const sorted = this.samples.slice(0, Math.min(this.n, SAMPLES)).sort();
+        const q = p => sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))] : 0;
+        return { count: this.n, p50: q(0.5), p99: q(0.99), max: this.max };
+    }
+}
+
+class SubmitPipeline {
+    constructor(contract, {
+        maxItems = 50, lingerMs = 20, maxInFlight = 8, maxQueued = 10000, maxAttempts = 5,
+        onCommitted = () => {}, onDeadLetter = () => {}, onStage = () => {}, onError = () => {},
+    } = {}) {
+        this.contract = contract;
+        this.onCommitted = onCommitted;
+        this.onDeadLetter = onDeadLetter;
+        this.onStage = onStage;
+        this.onError = onError;
+        this.maxItems = maxItems;
+        this.lingerMs = lingerMs;
+        this.maxInFlight = maxInFlight;
+        this.maxQueued = maxQueued;
+        this.maxAttempts = maxAttempts;
+
+        this.queue = [];            // { item, tag, queuedAt, attempts, alone }
+        this.inFlight = 0;
+        this.timer = null;
+        this.backoffMs = 0;
+        this.backoffTimer = null;
+        this.lastSubmit = Promise.resolve();
+        this.draining = false;
+        this.drained = null;
+
+        this.counts = { accepted: 0, committed: 0, rejected: 0, retried: 0, failed: 0 };
+        this.drainRate = 0;         // readings/s, smoothed
+        this.lastDrain = Date.now();
+        this.stages = {
+            queue: new StageStats(),
+            endorse: new StageStats(),
+            submit: new StageStats(),
+            commit: new StageStats(),
+        };
+    }
+
+    add(item, tag) {
+        if (this.queue.length >= this.maxQueued) {
+            const err = new Error('write queue full');
+            err.retryAfter = this.retryAfter(this.queue.length);
+            throw err;
+        }
+        this.queue.push({ item, tag, queuedAt: Date.now(), attempts: 0, alone: false });
+        this.counts.accepted++;
+        this.pump();
+    }
+
+    room() {
+        return this.maxQueued - this.queue.length;
+    }
+
+    // Seconds until a backlog of depth readings should have drained, 1..60.
+    retryAfter(depth) {
+        const rate = this.drainRate || 1;
+        return Math.min(60, Math.max(1, Math.ceil(depth / rate)));
+    }
+
+    pump() {
+        if (this.draining) return;
+        while (this.inFlight < this.maxInFlight && this.queue.length > 0 && !this.backoffTimer) {
+            const age = Date.now() - this.queue[0].queuedAt;
+            if (!this.queue[0].alone && this.queue.length < this.maxItems && age < this.lingerMs) {
+                if (!this.timer) {
+                    this.timer = setTimeout(() => {
+                        this.timer = null;
+                        this.pump();
+                    }, this.lingerMs - age);
+                }
+                return;
+            }
+            this.run(this.queue.splice(0, this.batchSize()));
+        }
+    }
+
+    // Entries under suspicion (alone) go one per batch.
+    batchSize() {
+        if (this.queue[0].alone) return 1;
+        let n = 1;
+        while (n < this.maxItems && n < this.queue.length && !this.queue[n].alone) n++;
+        return n;
+    }
+
+    observe(stage, ms) {
+        this.stages[stage].record(ms);
+        this.onStage(stage, ms);
+    }
+
+    async run(batch) {
+        this.inFlight++;
+        const prevSubmit = this.lastSubmit;
+        let submitted;
+        const mySubmit = new Promise(resolve => { submitted = resolve; });
+        this.lastSubmit = mySubmit;
+
+        const started = Date.now();
+        batch.forEach(e => this.observe('queue', started - e.queuedAt));
+        let stage = 'endorse';
+        try {
+            const proposal = this.contract.newProposal('CreateReadings', {
+                arguments: [JSON.stringify(batch.map(e => e.item))],
+            });
+            const transaction = await proposal.endorse();
+            const endorsed = Date.now();
+            this.observe('endorse', endorsed - started);
+
+            stage = 'submit';
+            await prevSubmit;
+            let commit;
+            try {
+                commit = await transaction.submit();
+            } finally {
+                submitted();
+            }
+            const sent = Date.now();
+            this.observe('submit', sent - endorsed);
+
+            stage = 'commit';
+            const status = await commit.getStatus();
+            this.observe('commit', Date.now() - sent);
+            if (!status.successful) {
+                const err = new Error(`transaction ${status.transactionId} invalid, code ${status.code}`);
+                err.txValidationCode = status.code;
+                throw err;
+            }
+
+            const rejected = [];
+            const reasons = [];
+            for (const r of JSON.parse(utf8.decode(transaction.getResult()))) {
+                if (r.error) {
+                    const { uuid, timestamp, seq } = batch[r.index].item;
+                    log.sample('reading rejected', { uuid, timestamp, seq, error: r.error });
+                    rejected.push(batch[r.index]);
+                    reasons.push(r.error);
+                }
+            }
+            this.counts.rejected += rejected.length;
+            this.counts.committed += batch.length - rejected.length;
+            this.noteDrained(batch.length);
+            this.backoffMs = 0;
+            if (rejected.length > 0) {
+                log.error('CreateReadings rejected readings', { rejected: rejected.length, batch: batch.length });
+                this.onDeadLetter(rejected, reasons);
+                this.onCommitted(batch.filter(e => !rejected.includes(e)).map(e => e.tag));
+            } else {
+                this.onCommitted(batch.map(e => e.tag));
+            }
+        } catch (err) {
+            submitted();
+            this.onError(stage, err);
+            this.failed(batch, stage, err);
+        } finally {
+            this.inFlight--;
+            if (this.draining && this.inFlight === 0) this.drained();
+            this.pump();
+        }
+    }
+
+    failed(batch, stage, err) {
+        const transient = isTransient(err);
+        let retry = batch;
+        if (!transient) {
+            batch.forEach(e => {
+                e.attempts++;
+                e.alone = true;
+            });
+            const dead = batch.filter(e => e.attempts >= this.maxAttempts);
+            if (dead.length > 0) {
+                retry = batch.filter(e => e.attempts < this.maxAttempts);
+                this.counts.failed += dead.length;
+                log.error('CreateReadings failed, giving up', {
+                    stage, readings: dead.length, attempts: this.maxAttempts, error: err.message,
+                });
+                this.onDeadLetter(dead, dead.map(() => err.message));
+            }
+        }
+        if (retry.length > 0) {
+            log.error('CreateReadings batch failed, retrying', {
+                stage, batch: retry.length, transient, error: err.message,
+            });
+            this.counts.retried += retry.length;
+            this.queue.unshift(...retry);
+        }
+        this.backoff();
+    }
+
+    // For shutdown: starts no more batches and resolves once the ones in
+    // flight have committed or failed. Whatever is still queued is in the
+    // write-ahead log for the next start.
+    drain() {
+        this.draining = true;
+        clearTimeout(this.timer);
+        clearTimeout(this.backoffTimer);
+        return new Promise(resolve => {
+            this.drained = resolve;
+            if (this.inFlight === 0) resolve();
+        });
+    }
+
+    backoff() {
+        this.backoffMs = Math.min(5000, (this.backoffMs || 100) * 2);
+        clearTimeout(this.backoffTimer);
+        this.backoffTimer = setTimeout(() => {
+            this.backoffTimer = null;
+            this.pump();
+        }, this.backoffMs);
+    }
+
+    noteDrained(n) {
+        const now = Date.now();
+        const dt = Math.max(1, now - this.lastDrain) / 1000;
+        this.lastDrain = now;
+        this.drainRate = this.drainRate ? 0.8 * this.drainRate + 0.2 * (n / dt) : n / dt;
+    }
+
+    stats() {
+        const stages = {};
+        for (const [name, s] of Object.entries(this.stages)) stages[name] = s.summary();
+        return {
+            queued: this.queue.length,
+            inFlight: this.inFlight,
+            drainRate: this.drainRate,
+            ...this.counts,
+            stages,
+        };
+    }
+}
+
+module.exports = { SubmitPipeline };
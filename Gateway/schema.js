@@ -0,0 +1,90 @@
+// The reading schema, compiled once into a validator and a serializer.
+//
+// A field list drives both. compileValidator() generates one straight-line
+// function that checks and coerces each field in turn; the base node sends
+// every value as a string, so numeric strings become numbers. It also
+// applies the ranges of the chaincode's SensorReading fields (uint8
+// colours, int8 acceleration, ...), which would otherwise only fail after
+// POST /reading has been acknowledged. compileSerializer() generates the
+// JSON for the same fields in a fixed order, without JSON.stringify's
+// walk over the object. Fields not in the schema are dropped.
+
+// name, type, min, max; in SensorReading's JSON order.
+const READING_FIELDS = [
+    ['uuid', 'string', 1, 64],
+    ['timestamp', 'integer', 1, Number.MAX_SAFE_INTEGER],
+    ['seq', 'integer', 0, 0xffffffff],
+    ['pressure', 'number', -Number.MAX_VALUE, Number.MAX_VALUE],
+    ['humidity', 'number', -Number.MAX_VALUE, Number.MAX_VALUE],
+    ['temperature', 'number', -Number.MAX_VALUE, Number.MAX_VALUE],
+    ['r', 'integer', 0, 255],
+    ['g', 'integer', 0, 255],
+    ['b', 'integer', 0, 255],
+    ['tvoc', 'integer', 0, 0xffff],
+    ['accel_x', 'integer', -128, 127],
+    ['accel_y', 'integer', -128, 127],
+    ['accel_z', 'integer', -128, 127],
+];
+
+// What the base node posts: the reading, with its advert counter in
+// timestamp (the gateway moves it to seq and stamps its own time).
+const INCOMING_FIELDS = READING_FIELDS
+    .filter(([name]) => name !== 'seq')
+    .map(f => f[0] === 'timestamp' ? ['timestamp', 'integer', 0, 0xffffffff] : f);
+
+// Returns validate(obj): a new object holding the schema's fields,
+// coerced, or null with validate.error saying which field is wrong.
+// Missing numeric fields are 0, as in the chaincode; strings are required.
+function compileValidator(fields) {
+    const lines = [
+        'if (o === null || typeof o !== "object" || Array.isArray(o)) { validate.error = "body must be an object"; return null; }',
+        'const out = {};',
+        'let v;',
+    ];
+    for (const [name, type, min, max] of fields) {
+        const key = JSON.stringify(name);
+        const fail = `{ validate.error = ${JSON.stringify(`${name} must be ${describe(type, min, max)}`)}; return null; }`;
+        lines.push(`v = o[${key}];`);
+        if (type === 'string') {
+            lines.push(`if (typeof v !== "string" || v.length < ${min} || v.length > ${max} || v.includes("\\0")) ${fail}`);
+        } else {
+            lines.push(
+                'if (v === undefined) v = 0;',
+                'else if (typeof v === "string") v = v.trim() === "" ? NaN : Number(v);',
+                `if (typeof v !== "number" || !(v >= ${min} && v <= ${max})${type === 'integer' ? ' || !Number.isInteger(v)' : ''}) ${fail}`);
+        }
+        lines.push(`out[${key}] = v;`);
+    }
+    lines.push('validate.error = null;', 'return out;');
+    // A named function expression, so the body's "validate" is itself.
+    return new Function(`return function validate(o) {\n${lines.join('\n')}\n};`)();
+}
+
+function describe(type, min, max) {
+    if (type === 'string') return `a string of ${min} to ${max} characters`;
+    if (min === -Number.MAX_VALUE) return 'a number';
+    return `an integer from ${min} to ${max}`;
+}
+
+// Returns serialize(obj) for objects validate() accepted.
+function compileSerializer(fields) {
+    const parts = fields.map(([name, type], i) => {
+        const prefix = JSON.stringify((i === 0 ? '{' : ',') + JSON.stringify(name) + ':');
+        const value = type === 'string' ? `str(o[${JSON.stringify(name)}])` : `o[${JSON.stringify(name)}]`;
+        return `${prefix} + ${value}`;
+    });
+    return new Function('str', `return function serialize(o) { return ${parts.join(' + ')} + "}"; };`)(quote);
+}
+
+// Strings that need no escaping are quoted directly.
+const PLAIN = /^[\x20\x21\x23-\x5b\x5d-\x7e]*$/;
+const quote = s => PLAIN.test(s) ? `"${s}"` : JSON.stringify(s);
+
+const validateIncoming = compileValidator(INCOMING_FIELDS);
+const validateReading = compileValidator(READING_FIELDS);
+const serializeReading = compileSerializer(READING_FIELDS);
+
+module.exports = {
+    READING_FIELDS, compileValidator, compileSerializer,
+    validateIncoming, validateReading, serializeReading,
+};
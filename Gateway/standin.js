@@ -0,0 +1,236 @@
+// In-process stand-in for the Fabric network, for load tests on one box
+// without a peer or orderer (LEDGER_BACKEND=standin).
+//
+// It has the same shape as FabricPool (fabric.js): a contract with
+// evaluateTransaction, submitTransaction and newProposal, a network with
+// getChaincodeEvents and getBlockEvents, and close(). Behind it is a map of
+// each device's readings, kept in timestamp order, standing in for
+// sensorCC's state:
+//
+//   evaluate  GetLatest, GetLatestMany, QueryDeviceRange
+//   submit    CreateReading, CreateReadings, CompactDevice (a no-op)
+//
+// Results are shaped like the chaincode's, and a committed write emits
+// the same "latest" chaincode event. Endorsement and commit take
+// endorseMs and commitMs, each +-jitter (a fraction), so the gateway's
+// queues and in-flight limits behave as they would against a network.
+// Commits land in blockMs-spaced blocks, like an orderer's batch timeout.
+// No blocks are delivered to getBlockEvents, so the mirror stays empty.
+// Anything else fails with gRPC status UNIMPLEMENTED.
+
+const { serializeReading, validateReading } = require('./schema');
+
+const enc = new TextEncoder();
+const sleep = ms => new Promise(resolve => setTimeout(resolve, ms));
+const MAX_PAGE = 1000;
+const UNIMPLEMENTED = 12;
+
+// An async iterable of pushed items, closeable like fabric-gateway's.
+class Feed {
+    constructor(onClose) {
+        this.items = [];
+        this.waiting = null;
+        this.closed = false;
+        this.onClose = onClose;
+    }
+
+    push(item) {
+        if (this.waiting) {
+            this.waiting({ value: item, done: false });
+            this.waiting = null;
+        } else {
+            this.items.push(item);
+        }
+    }
+
+    close() {
+        this.closed = true;
+        this.onClose(this);
+        this.waiting?.({ value: undefined, done: true });
+    }
+
+    [Symbol.asyncIterator]() {
+        return {
+            next: () => {
+                if (this.items.length > 0) return Promise.resolve({ value: this.items.shift(), done: false });
+                if (this.closed) return Promise.resolve({ value: undefined, done: true });
+                return new Promise(resolve => { this.waiting = resolve; });
+            },
+        };
+    }
+}
+
+class StandInLedger {
+    constructor({ endorseMs = 20, commitMs = 500, blockMs = 250, jitter = 0.2 } = {}) {
+        Object.assign(this, { endorseMs, commitMs, blockMs, jitter });
+        this.devices = new Map();   // uuid -> [{ timestamp, seq, json }], ascending
+        this.latest = new Map();    // uuid -> { timestamp, seq, json }
+        this.feeds = new Set();
+        this.epoch = Math.floor(Date.now() / blockMs);
+        this.blockNumber = 0n;
+        this.txCount = 0;
+
+        this.contract = {
+            evaluateTransaction: async (name, ...args) => {
+                await sleep(this.delay(this.endorseMs));
+                return enc.encode(this.evaluate(name, args));
+            },
+            submitTransaction: async (name, ...args) => {
+                const tx = await this.contract.newProposal(name, { arguments: args }).endorse();
+                const commit = await tx.submit();
+                const status = await commit.getStatus();
+                if (!status.successful) throw new Error(`transaction ${status.transactionId} invalid`);
+                return tx.getResult();
+            },
+            newProposal: (name, { arguments: args = [] } = {}) => this.proposal(name, args),
+        };
+        this.network = {
+            getChaincodeEvents: async () => this.feed(),
+            getBlockEvents: async () => new Feed(() => {}),
+        };
+    }
+
+    delay(ms) {
+        return ms * (1 + this.jitter * (2 * Math.random() - 1));
+    }
+
+    feed() {
+        const f = new Feed(closed => this.feeds.delete(closed));
+        this.feeds.add(f);
+        return f;
+    }
+
+    // Endorsement simulates the transaction and keeps its writes; they are
+    // applied and announced only when its block commits.
+    proposal(name, args) {
+        return {
+            endorse: async () => {
+                await sleep(this.delay(this.endorseMs));
+                const { result, writes } = this.simulate(name, args);
+                const transactionId = `standin-${++this.txCount}`;
+                return {
+                    getResult: () => enc.encode(result),
+                    getTransactionId: () => transactionId,
+                    submit: async () => {
+                        const committed = this.commitAfter(this.delay(this.commitMs)).then(block => {
+                            this.apply(writes, block, transactionId);
+                            return block;
+                        });
+                        return {
+                            getTransactionId: () => transactionId,
+                            getStatus: async () => {
+                                const blockNumber = await committed;
+                                return { successful: true, code: 0, blockNumber, transactionId };
+                            },
+                        };
+                    },
+                };
+            },
+        };
+    }
+
+    // Resolves with the number of the first block cut at least ms from now;
+    // blocks are cut every blockMs.
+    async commitAfter(ms) {
+        const cut = Math.ceil((Date.now() + ms) / this.blockMs);
+        await sleep(cut * this.blockMs - Date.now());
+        const number = BigInt(cut - this.epoch);
+        if (number > this.blockNumber) this.blockNumber = number;
+        return number;
+    }
+
+    simulate(name, args) {
+        switch (name) {
+        case 'CreateReading': {
+            const [uuid, ts, seq, blob] = args;
+            const r = validateReading({ ...JSON.parse(blob), uuid, timestamp: Number(ts), seq: Number(seq) });
+            if (!r) throw Object.assign(new Error(validateReading.error), { code: 2 });
+            return { result: '', writes: [r] };
+        }
+        case 'CreateReadings': {
+            const writes = [];
+            const results = JSON.parse(args[0]).map((item, index) => {
+                const r = validateReading(item);
+                if (!r) return { index, error: validateReading.error };
+                writes.push(r);
+                return { index };
+            });
+            return { result: JSON.stringify(results), writes };
+        }
+        case 'CompactDevice':
+            return { result: '{"more":false}', writes: [] };
+        default:
+            throw this.unimplemented(name);
+        }
+    }
+
+    apply(writes, blockNumber, transactionId) {
+        const newest = new Map();
+        for (const r of writes) {
+            const row = { timestamp: r.timestamp, seq: r.seq, json: serializeReading(r) };
+            let rows = this.devices.get(r.uuid);
+            if (!rows) this.devices.set(r.uuid, rows = []);
+            let i = rows.length;
+            while (i > 0 && (rows[i - 1].timestamp > row.timestamp
+                || (rows[i - 1].timestamp === row.timestamp && rows[i - 1].seq > row.seq))) i--;
+            if (i > 0 && rows[i - 1].timestamp === row.timestamp && rows[i - 1].seq === row.seq) {
+                rows[i - 1] = row;
+            } else {
+                rows.splice(i, 0, row);
+            }
+            const prev = this.latest.get(r.uuid);
+            if (!prev || row.timestamp >= prev.timestamp) {
+                this.latest.set(r.uuid, row);
+                newest.set(r.uuid, row);
+            }
+        }
+        if (newest.size === 0) return;
+        const payload = enc.encode(`[${[...newest.values()].map(row => row.json).join(',')}]`);
+        const event = { chaincodeName: 'sensorCC', eventName: 'latest', payload, blockNumber, transactionId };
+        this.feeds.forEach(f => f.push(event));
+    }
+
+    evaluate(name, args) {
+        switch (name) {
+        case 'GetLatest': {
+            const row = this.latest.get(args[0]);
+            if (!row) throw Object.assign(new Error(`no readings for ${args[0]}`), { code: 2 });
+            return row.json;
+        }
+        case 'GetLatestMany':
+            return `[${JSON.parse(args[0]).map(uuid => this.latest.get(uuid)?.json).filter(Boolean).join(',')}]`;
+        case 'QueryDeviceRange': {
+            // The bookmark is the index of the next row, not a ledger key.
+            const [uuid, from, to, pageSize, bookmark] = args;
+            const rows = this.devices.get(uuid) || [];
+            const size = Math.min(MAX_PAGE, Number(pageSize) || MAX_PAGE);
+            let i = bookmark ? Number(bookmark) : rows.findIndex(row => row.timestamp >= Number(from));
+            if (i < 0) i = rows.length;
+            const page = [];
+            for (; i < rows.length && page.length < size && rows[i].timestamp <= Number(to); i++) {
+                page.push(rows[i].json);
+            }
+            const more = i < rows.length && rows[i].timestamp <= Number(to);
+            return `{"readings":[${page.join(',')}],"bookmark":"${more ? i : ''}"}`;
+        }
+        default:
+            throw this.unimplemented(name);
+        }
+    }
+
+    unimplemented(name) {
+        return Object.assign(new Error(`${name} is not implemented by the stand-in ledger`), { code: UNIMPLEMENTED });
+    }
+
+    stats() {
+        let readings = 0;
+        for (const rows of this.devices.values()) readings += rows.length;
+        return { devices: this.devices.size, readings, blocks: Number(this.blockNumber), transactions: this.txCount };
+    }
+
+    close() {
+        [...this.feeds].forEach(f => f.close());
+    }
+}
+
+module.exports = { StandInLedger };
@@ -0,0 +1,142 @@
+// Live readings for GET /stream?uuids=AB12,CD34, so clients stop polling.
+//
+// A subscriber first gets the cached latest reading of each device it asked
+// for, then every newer one as the LatestCache learns about it from the
+// chaincode's "latest" events, i.e. about one commit after the reading was
+// submitted. Two transports share the same fan-out:
+//
+//   SSE        plain GET with Accept: text/event-stream; one
+//              "event: reading" per update, id = the entry's ETag
+//   WebSocket  upgrade on the same path; one text frame per update
+//
+// Nothing is queued per subscriber beyond the socket's own write buffer.
+// When that holds more than maxBufferedBytes the subscriber is not keeping
+// up, and it is disconnected rather than let the gateway's memory grow; a
+// reconnect starts again from the current values. Heartbeats every
+// heartbeatMs keep proxies from closing idle streams and find dead
+// WebSocket peers.
+
+const { WebSocketServer } = require('ws');
+
+const MAX_UUIDS = 100;
+
+class StreamHub {
+    constructor(latest, { maxBufferedBytes = 256 << 10, heartbeatMs = 15000 } = {}) {
+        this.latest = latest;
+        this.maxBufferedBytes = maxBufferedBytes;
+        this.topics = new Map();    // uuid -> Set of subscribers
+        this.subscribers = new Set();
+        this.counts = { opened: 0, evicted: 0, sent: 0 };
+        this.wss = new WebSocketServer({ noServer: true, maxPayload: 1024 });
+
+        latest.on('update', (uuid, entry) => this.publish(uuid, entry));
+        setInterval(() => this.subscribers.forEach(s => s.heartbeat()), heartbeatMs).unref();
+    }
+
+    // The uuids query parameter as a list, or null if it is missing or too
+    // long.
+    static parseUuids(value) {
+        const uuids = [...new Set(String(value || '').split(',').filter(Boolean))];
+        return uuids.length > 0 && uuids.length <= MAX_UUIDS ? uuids : null;
+    }
+
+    publish(uuid, entry) {
+        const subs = this.topics.get(uuid);
+        if (!subs) return;
+        for (const sub of subs) this.deliver(sub, entry);
+    }
+
+    deliver(sub, entry) {
+        if (sub.buffered() > this.maxBufferedBytes) {
+            this.counts.evicted++;
+            this.remove(sub);
+            sub.evict();
+            return;
+        }
+        sub.send(entry);
+        this.counts.sent++;
+    }
+
+    add(sub, uuids) {
+        sub.uuids = uuids;
+        this.subscribers.add(sub);
+        this.counts.opened++;
+        for (const uuid of uuids) {
+            if (!this.topics.has(uuid)) this.topics.set(uuid, new Set());
+            this.topics.get(uuid).add(sub);
+        }
+        for (const uuid of uuids) {
+            const entry = this.latest.get(uuid);
+            if (entry) this.deliver(sub, entry);
+        }
+    }
+
+    remove(sub) {
+        if (!this.subscribers.delete(sub)) return;
+        for (const uuid of sub.uuids) {
+            const subs = this.topics.get(uuid);
+            subs.delete(sub);
+            if (subs.size === 0) this.topics.delete(uuid);
+        }
+    }
+
+    sse(req, res, uuids) {
+        res.writeHead(200, {
+            'Content-Type': 'text/event-stream',
+            'Cache-Control': 'no-cache',
+            'Connection': 'keep-alive',
+            'X-Accel-Buffering': 'no',
+        });
+        res.write('retry: 5000\n\n');
+        const sub = {
+            send: entry => res.write(`event: reading\nid: ${entry.etag}\ndata: ${entry.body}\n\n`),
+            buffered: () => res.writableLength,
+            heartbeat: () => res.write(':\n\n'),
+            evict: () => res.destroy(),
+        };
+        res.on('close', () => this.remove(sub));
+        this.add(sub, uuids);
+    }
+
+    // For the HTTP server's 'upgrade' event; anything but /stream with a
+    // valid uuids list is refused.
+    upgrade(req, socket, head) {
+        const url = new URL(req.url, 'http://localhost');
+        const uuids = url.pathname === '/stream' && StreamHub.parseUuids(url.searchParams.get('uuids'));
+        if (!uuids) {
+            socket.end('HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n');
+            return;
+        }
+        this.wss.handleUpgrade(req, socket, head, ws => {
+            let alive = true;
+            const sub = {
+                send: entry => ws.send(entry.body),
+                buffered: () => ws.bufferedAmount,
+                heartbeat: () => {
+                    if (!alive) return ws.terminate();
+                    alive = false;
+                    ws.ping();
+                },
+                evict: () => ws.terminate(),
+            };
+            ws.on('pong', () => { alive = true; });
+            ws.on('close', () => this.remove(sub));
+            ws.on('error', () => ws.terminate());
+            this.add(sub, uuids);
+        });
+    }
+
+    // Disconnects everyone, for shutdown.
+    close() {
+        for (const sub of [...this.subscribers]) {
+            this.remove(sub);
+            sub.evict();
+        }
+    }
+
+    stats() {
+        return { subscribers: this.subscribers.size, devices: this.topics.size, ...this.counts };
+    }
+}
+
+module.exports = { StreamHub };
@@ -0,0 +1,31 @@
+const test = require('node:test');
+const assert = require('node:assert');
+const { Mirror } = require('../mirror');
+
+function row(uuid, ts, temperature) {
+    return {
+        uuid, ts, seq: 0, pressure: 1013, humidity: 40, temperature,
+        r: 0, g: 0, b: 0, tvoc: 0, accel_x: 0, accel_y: 0, accel_z: 0,
+    };
+}
+
+test('downsample puts several readings in each bucket', () => {
+    const mirror = new Mirror(':memory:', 'sensorCC');
+    // One reading every 5 s from ts 1000, 10 min in all: 12 to a minute.
+    for (let i = 0; i < 120; i++) mirror.insert.run(row('AB12', 1000 + i * 5000, i % 12));
+    mirror.insert.run(row('CD34', 1000, 99));
+
+    const buckets = mirror.downsample('AB12', 0, Number.MAX_SAFE_INTEGER, 60000);
+    assert.strictEqual(buckets.length, 10);
+    buckets.forEach((b, i) => {
+        assert.strictEqual(b.start, i * 60000);
+        assert.strictEqual(b.count, 12);
+        assert.strictEqual(b.temperature_min, 0);
+        assert.strictEqual(b.temperature_max, 11);
+        assert.strictEqual(b.temperature_avg, 5.5);
+    });
+
+    // A window that starts mid-bucket still groups on bucket boundaries.
+    const tail = mirror.downsample('AB12', 540000, Number.MAX_SAFE_INTEGER, 60000);
+    assert.deepStrictEqual(tail.map(b => [b.start, b.count]), [[540000, 12]]);
+});
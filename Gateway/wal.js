@@ -0,0 +1,285 @@
+// Segmented write-ahead log for incoming readings.
+//
+// Every reading is appended here and fsynced before POST /reading is
+// acknowledged, so a reading the base node was told about survives a peer
+// outage or a gateway restart. A committer reads the log back in order and
+// feeds the submit pipeline; commit() records what has reached the ledger.
+//
+// On disk, under dir:
+//   <first lsn, 16 digits>.log   records: u32 len | u32 crc32 | payload (BE)
+//   checkpoint.json              { "lsn": n }, every record below n is on
+//                                the ledger
+//
+// Appends are group-committed: whatever arrives while one write+fdatasync
+// is in progress goes out in the next one. A segment is closed once it
+// passes segmentBytes and deleted once the checkpoint is past its last
+// record. After a restart, reading resumes at the checkpoint; records that
+// were committed after the last checkpoint write are submitted again,
+// which the chaincode's blind, deterministic-key writes make harmless.
+// A torn record at the end of the last segment is cut off. checkpoint.json
+// is replaced atomically (fsynced, renamed, directory fsynced); should it
+// still be unreadable, the log is replayed from its first segment.
+
+const fs = require('fs');
+const fsp = fs.promises;
+const path = require('path');
+const { EventEmitter } = require('events');
+const { log } = require('./log');
+
+const HEADER = 8;
+
+const CRC_TABLE = new Int32Array(256).map((_, n) => {
+    let c = n;
+    for (let k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+    return c;
+});
+
+function crc32(buf) {
+    let c = -1;
+    for (let i = 0; i < buf.length; i++) c = CRC_TABLE[(c ^ buf[i]) & 0xff] ^ (c >>> 8);
+    return (c ^ -1) >>> 0;
+}
+
+const segmentName = lsn => String(lsn).padStart(16, '0') + '.log';
+
+// Parses the whole records in buf. Returns them and the bytes consumed;
+// stops at a short or corrupt record.
+function parseRecords(buf, max = Infinity) {
+    const records = [];
+    let off = 0;
+    while (records.length < max && off + HEADER <= buf.length) {
+        const len = buf.readUInt32BE(off);
+        if (off + HEADER + len > buf.length) break;
+        const payload = buf.subarray(off + HEADER, off + HEADER + len);
+        if (crc32(payload) !== buf.readUInt32BE(off + 4)) break;
+        records.push(payload);
+        off += HEADER + len;
+    }
+    return { records, used: off };
+}
+
+class WriteAheadLog extends EventEmitter {
+    constructor(dir, { segmentBytes = 16 << 20, checkpointMs = 1000 } = {}) {
+        super();
+        this.dir = dir;
+        this.segmentBytes = segmentBytes;
+        this.checkpointMs = checkpointMs;
+
+        this.segments = [];     // first lsn of each segment, ascending
+        this.fd = null;         // append handle on the last segment
+        this.size = 0;          // bytes in the last segment
+        this.nextLsn = 0;       // lsn the next append gets
+        this.durableLsn = 0;    // every lsn below this is fsynced
+
+        this.pending = [];      // { buf, resolve, reject }
+        this.flushing = false;
+
+        this.checkpoint = 0;    // every lsn below this is committed
+        this.done = new Set();  // committed lsns at or above checkpoint
+        this.savedCheckpoint = 0;
+        this.checkpointTimer = null;
+
+        this.cursor = null;     // { base, offset, lsn }: segment, byte and lsn of the next read
+    }
+
+    async open() {
+        await fsp.mkdir(this.dir, { recursive: true });
+        const cpFile = path.join(this.dir, 'checkpoint.json');
+        let text = null;
+        try {
+            text = await fsp.readFile(cpFile, 'utf8');
+        } catch (err) {
+            if (err.code !== 'ENOENT') throw err;
+        }
+        if (text !== null) {
+            try {
+                const { lsn } = JSON.parse(text);
+                if (!Number.isSafeInteger(lsn) || lsn < 0) throw new Error(`bad lsn ${lsn}`);
+                this.checkpoint = this.savedCheckpoint = lsn;
+            } catch (err) {
+                // Replaying what is already on the ledger is harmless; losing
+                // what is not would not be.
+                log.error('wal checkpoint unreadable, replaying the log', { file: cpFile, error: err.message });
+            }
+        }
+
+        this.segments = (await fsp.readdir(this.dir))
+            .filter(f => /^\d{16}\.log$/.test(f))
+            .map(f => Number(f.slice(0, 16)))
+            .sort((a, b) => a - b);
+        if (this.segments.length === 0) {
+            this.segments.push(this.checkpoint);
+        }
+
+        // Find the end of the last segment, cutting off a torn tail.
+        const last = this.segments[this.segments.length - 1];
+        const file = path.join(this.dir, segmentName(last));
+        let buf = Buffer.alloc(0);
+        try {
+            buf = await fsp.readFile(file);
+        } catch (err) {
+            if (err.code !== 'ENOENT') throw err;
+        }
+        const { records, used } = parseRecords(buf);
+        this.fd = await fsp.open(file, 'a+');
+        if (used < buf.length) {
+            log.error('wal torn tail dropped', { file, bytes: buf.length - used });
+            await this.fd.truncate(used);
+        }
+        this.size = used;
+        this.nextLsn = this.durableLsn = Math.max(last + records.length, this.checkpoint);
+
+        const base = this.segments.findLast(s => s <= this.checkpoint) ?? this.segments[0];
+        this.cursor = { base, offset: 0, lsn: base };
+    }
+
+    // Appends one record; resolves with its lsn once it is on disk.
+    append(payload) {
+        return new Promise((resolve, reject) => {
+            const buf = Buffer.allocUnsafe(HEADER + payload.length);
+            buf.writeUInt32BE(payload.length, 0);
+            buf.writeUInt32BE(crc32(payload), 4);
+            payload.copy(buf, HEADER);
+            this.pending.push({ buf, resolve, reject });
+            if (!this.flushing) this.flush();
+        });
+    }
+
+    async flush() {
+        this.flushing = true;
+        while (this.pending.length > 0) {
+            const group = this.pending;
+            this.pending = [];
+            try {
+                if (this.size > 0 && this.size >= this.segmentBytes) {
+                    await this.rotate();
+                }
+                const data = Buffer.concat(group.map(p => p.buf));
+                await this.fd.write(data, 0, data.length);
+                await this.fd.datasync();
+                this.size += data.length;
+            } catch (err) {
+                // Cut off whatever part of the group made it to disk so the
+                // next append does not land behind a torn record.
+                await this.fd.truncate(this.size).catch(() => {});
+                group.forEach(p => p.reject(err));
+                continue;
+            }
+            const first = this.nextLsn;
+            this.nextLsn += group.length;
+            this.durableLsn = this.nextLsn;
+            group.forEach((p, i) => p.resolve(first + i));
+            this.emit('durable');
+        }
+        this.flushing = false;
+    }
+
+    async rotate() {
+        const fd = await fsp.open(path.join(this.dir, segmentName(this.nextLsn)), 'a+');
+        await this.fd.close();
+        this.fd = fd;
+        this.segments.push(this.nextLsn);
+        this.size = 0;
+    }
+
+    // Reads up to max durable records that have not been read yet, as
+    // [{ lsn, payload }], in lsn order.
+    async read(max) {
+        const out = [];
+        const c = this.cursor;
+        while (out.length < max && c.lsn < this.durableLsn) {
+            const file = path.join(this.dir, segmentName(c.base));
+            const lastSeg = c.base === this.segments[this.segments.length - 1];
+            const end = lastSeg ? this.size : (await fsp.stat(file)).size;
+            if (c.offset >= end) {
+                if (lastSeg) break;
+                // Looked up after the await: checkpointing may have dropped
+                // older segments meanwhile.
+                c.base = this.segments[this.segments.indexOf(c.base) + 1];
+                c.offset = 0;
+                continue;
+            }
+            const fh = await fsp.open(file, 'r');
+            try {
+                const buf = Buffer.allocUnsafe(Math.min(end - c.offset, 1 << 20));
+                const { bytesRead } = await fh.read(buf, 0, buf.length, c.offset);
+                const { records, used } = parseRecords(buf.subarray(0, bytesRead), max - out.length);
+                if (used === 0) {
+                    throw new Error(`wal: unreadable record in ${file} at ${c.offset}`);
+                }
+                for (const payload of records) {
+                    // After a restart, skip what the checkpoint says is done.
+                    if (c.lsn >= this.checkpoint) out.push({ lsn: c.lsn, payload });
+                    c.lsn++;
+                }
+                c.offset += used;
+            } finally {
+                await fh.close();
+            }
+        }
+        return out;
+    }
+
+    // Marks lsns as on the ledger and moves the checkpoint past every
+    // record that is.
+    commit(lsns) {
+        lsns.forEach(lsn => this.done.add(lsn));
+        while (this.done.delete(this.checkpoint)) this.checkpoint++;
+        if (!this.checkpointTimer && this.checkpoint > this.savedCheckpoint) {
+            this.checkpointTimer = setTimeout(() => this.saveCheckpoint(), this.checkpointMs);
+        }
+    }
+
+    async saveCheckpoint() {
+        const lsn = this.checkpoint;
+        const file = path.join(this.dir, 'checkpoint.json');
+        try {
+            const fh = await fsp.open(file + '.tmp', 'w');
+            try {
+                await fh.writeFile(JSON.stringify({ lsn }));
+                await fh.sync();
+            } finally {
+                await fh.close();
+            }
+            await fsp.rename(file + '.tmp', file);
+            const dir = await fsp.open(this.dir, 'r');
+            try {
+                await dir.sync();
+            } finally {
+                await dir.close();
+            }
+            this.savedCheckpoint = lsn;
+
+            // Drop closed segments whose records are all below the checkpoint
+            // and behind the read cursor.
+            while (this.segments.length > 1 && this.segments[1] <= lsn
+                && this.segments[0] < this.cursor.base) {
+                await fsp.unlink(path.join(this.dir, segmentName(this.segments.shift())));
+            }
+        } catch (err) {
+            log.error('wal checkpoint failed', { error: err.message });
+        } finally {
+            this.checkpointTimer = null;
+            if (this.checkpoint > this.savedCheckpoint) this.commit([]);
+        }
+    }
+
+    stats() {
+        return {
+            // appended but not yet on the ledger / not yet read back
+            depth: this.nextLsn - this.checkpoint,
+            unread: this.durableLsn - Math.max(this.cursor.lsn, this.checkpoint),
+            segments: this.segments.length,
+            nextLsn: this.nextLsn,
+            checkpoint: this.checkpoint,
+        };
+    }
+
+    async close() {
+        clearTimeout(this.checkpointTimer);
+        if (this.checkpoint > this.savedCheckpoint) await this.saveCheckpoint();
+        await this.fd.close();
+    }
+}
+
+module.exports = { WriteAheadLog, crc32 };
@@ -4,7 +4,7 @@ K_MSGQ_DEFINE(ble_msgq, sizeof(struct ble_adv), 2, 4);
 
 static uint8_t ble_data[] = {
 
-    0xA3, 0xF9, 0xC2, 0xB7,     // prefix
+    BLE_FRAME_PREFIX_BYTES,     // prefix
     UUID0, UUID1, UUID2, UUID3, // uuid
     0x00, 0x00,                 // timestamp
     0x00,                       // pressure
@@ -6,6 +6,7 @@
 #include <zephyr/sys/printk.h>
 #include <zephyr/settings/settings.h>
 #include <stdio.h>
+#include "ble_frame.h"
 
 #define BLE_NAME_LEN 32
 #define MAC_ADDR_LEN 6
@@ -0,0 +1,39 @@
+#ifndef BLE_FRAME_H
+#define BLE_FRAME_H
+
+/*
+ * Wire format of a sensor frame: the manufacturer data a mobile node
+ * advertises (advertise.c) and the base node scans (scan.c). Multi-byte
+ * fields are little-endian. Plain C with no Zephyr headers, so the gateway's
+ * native decoder (Gateway/native/frames.c) builds from the same definition.
+ */
+
+#include <stdint.h>
+
+#define BLE_FRAME_PREFIX_BYTES 0xA3, 0xF9, 0xC2, 0xB7
+
+#define BLE_FRAME_MEMBERS     \
+    uint8_t prefix[4];        \
+    uint8_t uuid[4];          \
+    uint16_t timestamp;       \
+    uint8_t pressure;         \
+    uint8_t humidity;         \
+    uint8_t temperature;      \
+    uint8_t r;                \
+    uint8_t g;                \
+    uint8_t b;                \
+    uint16_t tvoc;            \
+    int8_t accel_x;           \
+    int8_t accel_y;           \
+    int8_t accel_z;
+
+struct __attribute__((__packed__)) ble_frame
+{
+    BLE_FRAME_MEMBERS
+};
+
+#define BLE_FRAME_SIZE sizeof(struct ble_frame)
+
+static const uint8_t ble_frame_prefix[4] = {BLE_FRAME_PREFIX_BYTES};
+
+#endif
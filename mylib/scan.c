@@ -42,7 +42,7 @@ void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t adv_type, struct net
 
     // snprintk(uuid, sizeof(uuid), "%02X:%02X:%02X:%02X", ble.uuid[0], ble.uuid[1], ble.uuid[2], ble.uuid[3]);
 
-    if (ble.prefix[0] != 0xA3 || ble.prefix[1] != 0xF9 || ble.prefix[2] != 0xC2 || ble.prefix[3] != 0xB7)
+    if (memcmp(ble.prefix, ble_frame_prefix, sizeof(ble_frame_prefix)) != 0)
     {
         return;
     }
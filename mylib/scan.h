@@ -10,26 +10,16 @@
 #include <zephyr/settings/settings.h>
 #include "node_list.h"
 #include "wifi.h"
+#include "ble_frame.h"
 
 #define STACKSIZE 8192
 #define PRIORITY 7
 #define SCAN_TIME 100
+// AD flags and the manufacturer data header, then the sensor frame
 struct __packed  ble_adv
 {
     uint8_t ble_prefix[5];
-    uint8_t prefix[4];
-    uint8_t uuid[4];
-    uint16_t timestamp;
-    uint8_t pressure;
-    uint8_t humidity;
-    uint8_t temperature;
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
-    uint16_t tvoc;
-    int8_t accel_x;
-    int8_t accel_y;
-    int8_t accel_z;
+    BLE_FRAME_MEMBERS
 };
 
 #endif
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/data/json.h>
 #include <zephyr/arch/arch_interface.h>
+#include <zephyr/input/input.h>
+#include <zephyr/sys/atomic.h>
 #include <lvgl.h>
 #include <stdio.h>
 #include <string.h>
@@ -20,6 +22,9 @@ LOG_MODULE_REGISTER(app, CONFIG_LOG_DEFAULT_LEVEL);
 #define STACK_SIZE_WIFI 8192
 #define PRIORITY_WIFI    7
 
+// How often the UI thread logs its wakeups, busy time and touch latency
+#define UI_STATS_MS 60000
+
 // Definitions for Vibration Thread
 #define STACK_SIZE_VIBRATION 2048
 #define PRIORITY_VIBRATION    6 
@@ -57,6 +62,86 @@ static void vibration_management_thread() {
     regulator_disable(vibration_regulator);
 }
 
+// Raised for every touch controller report; wakes the UI thread. The touch
+// itself reaches LVGL through its own input callback.
+static struct k_poll_signal touch_signal = K_POLL_SIGNAL_INITIALIZER(touch_signal);
+// Cycle count (never 0) of the oldest touch report the UI thread has not
+// handled yet; 0 when there is none
+static atomic_t touch_cycles;
+
+static void on_input(struct input_event *evt, void *user_data)
+{
+    ARG_UNUSED(user_data);
+    if (!evt->sync) {
+        return;
+    }
+    atomic_cas(&touch_cycles, 0, (atomic_val_t)(k_cycle_get_32() | 1));
+    k_poll_signal_raise(&touch_signal, 0);
+}
+INPUT_CALLBACK_DEFINE(NULL, on_input, NULL);
+
+// Reads the pointer now rather than at LVGL's next input poll. If LVGL's
+// input callback has not queued the report yet, its timer still picks it up.
+static void read_pointer(void)
+{
+    lv_indev_t *indev = NULL;
+    while ((indev = lv_indev_get_next(indev)) != NULL) {
+        if (lv_indev_get_type(indev) == LV_INDEV_TYPE_POINTER) {
+            lv_indev_read(indev);
+        }
+    }
+}
+
+static void show_reading(const struct sensor_data *data)
+{
+    ui_env_set_temp(data->temperature);
+    ui_env_set_hum(data->humidity);
+    ui_env_set_press(data->pressure);
+    ui_env_set_tvoc(data->tvoc);
+    ui_motion_set_xyz(data->accel_x, data->accel_y, data->accel_z);
+    ui_light_set_rgb(data->r, data->g, data->b);
+}
+
+// Starts or stops the vibration thread for a new reading.
+static void check_thresholds(const struct sensor_data *data)
+{
+    thresholds_exceeded = sensor_data_exceeds_thresholds(
+            data->temperature, data->humidity, data->pressure,
+            data->tvoc, data->accel_x, data->accel_y, data->accel_z,
+            data->r, data->g, data->b);
+
+    if (thresholds_exceeded) {
+        if (vibration_thread_handle == NULL) {
+            stop_vibration_signal_flag = false;
+            vibration_thread_handle = k_thread_create(&vibration_thread_data_obj,
+                                             vibration_thread_stack_area,
+                                             STACK_SIZE_VIBRATION,
+                                             vibration_management_thread,
+                                             NULL, NULL, NULL,
+                                             PRIORITY_VIBRATION,
+                                             0, K_NO_WAIT);
+            if (vibration_thread_handle == NULL) {
+                LOG_ERR("Failed to create vibration thread");
+            } else {
+                k_thread_name_set(vibration_thread_handle, "vibration_mgmt");
+            }
+        }
+    } else { 
+        if (vibration_thread_handle != NULL) {
+            stop_vibration_signal_flag = true;
+            int ret = k_thread_join(vibration_thread_handle, K_MSEC(500));
+            if (ret == -EAGAIN) {
+                k_thread_abort(vibration_thread_handle);
+                regulator_disable(vibration_regulator);
+            } 
+            vibration_thread_handle = NULL;
+        }
+    }
+}
+
+// Sleeps until a reading arrives, the screen is touched or LVGL's next
+// timer is due, whichever is first. Thresholds are only checked when a
+// reading arrives.
 static void ui_thread()
 {
     const struct device *disp = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
@@ -68,85 +153,89 @@ static void ui_thread()
     ui_init();
     display_blanking_off(disp);
 
+    struct k_poll_event events[] = {
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_MSGQ_DATA_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY, &sensor_msgq),
+        K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &touch_signal),
+    };
+    uint32_t wakeups = 0, busy_cycles = 0, touches = 0, touch_us_max = 0;
+    uint64_t touch_us_sum = 0;
+    int64_t stats_at = k_uptime_get();
+
     while (1) {
-        struct sensor_data current_sensor_data; // Variable to hold data from queue
-        bool new_data_from_queue = false;       // Flag to track if new data was received
-
-        if (k_msgq_get(&sensor_msgq, &current_sensor_data, K_NO_WAIT) == 0) {
-            // New data is available, update UI
-            ui_env_set_temp(current_sensor_data.temperature);
-            ui_env_set_hum(current_sensor_data.humidity);
-            ui_env_set_press(current_sensor_data.pressure);
-            ui_env_set_tvoc(current_sensor_data.tvoc);
-            ui_motion_set_xyz(current_sensor_data.accel_x, current_sensor_data.accel_y, current_sensor_data.accel_z);
-            ui_light_set_rgb(current_sensor_data.r, current_sensor_data.g, current_sensor_data.b);
-            new_data_from_queue = true;
+        uint32_t started = k_cycle_get_32();
+
+        k_poll_signal_reset(&touch_signal);
+        uint32_t touched = (uint32_t)atomic_set(&touch_cycles, 0);
+        if (touched) {
+            read_pointer();
         }
 
-        thresholds_exceeded = sensor_data_exceeds_thresholds(
-                current_sensor_data.temperature, current_sensor_data.humidity, current_sensor_data.pressure,
-                current_sensor_data.tvoc, current_sensor_data.accel_x, current_sensor_data.accel_y, current_sensor_data.accel_z,
-                current_sensor_data.r, current_sensor_data.g, current_sensor_data.b);
+        // Only the newest reading matters; older ones are already stale.
+        struct sensor_data data;
+        bool have_data = false;
+        while (k_msgq_get(&sensor_msgq, &data, K_NO_WAIT) == 0) {
+            have_data = true;
+        }
+        if (have_data) {
+            show_reading(&data);
+            check_thresholds(&data);
+        }
 
-        if (thresholds_exceeded) {
-            if (vibration_thread_handle == NULL) {
-                stop_vibration_signal_flag = false;
-                vibration_thread_handle = k_thread_create(&vibration_thread_data_obj,
-                                                 vibration_thread_stack_area,
-                                                 STACK_SIZE_VIBRATION,
-                                                 vibration_management_thread,
-                                                 NULL, NULL, NULL,
-                                                 PRIORITY_VIBRATION,
-                                                 0, K_NO_WAIT);
-                if (vibration_thread_handle == NULL) {
-                    LOG_ERR("Failed to create vibration thread");
-                } else {
-                    k_thread_name_set(vibration_thread_handle, "vibration_mgmt");
-                }
-            }
-        } else { 
-            if (vibration_thread_handle != NULL) {
-                stop_vibration_signal_flag = true;
-                int ret = k_thread_join(vibration_thread_handle, K_MSEC(500));
-                if (ret == -EAGAIN) {
-                    k_thread_abort(vibration_thread_handle);
-                    regulator_disable(vibration_regulator);
-                } 
-                vibration_thread_handle = NULL;
-            }
+        uint32_t next = lv_timer_handler();
+
+        // Touch latency: from the controller's report to the end of the
+        // LVGL pass that read it and redrew.
+        uint32_t done = k_cycle_get_32();
+        if (touched) {
+            uint32_t us = k_cyc_to_us_floor32(done - touched);
+            touches++;
+            touch_us_sum += us;
+            touch_us_max = MAX(touch_us_max, us);
         }
-        
-        lv_timer_handler();
-        k_msleep(10);
+        wakeups++;
+        busy_cycles += done - started;
+
+        if (k_uptime_get() - stats_at >= UI_STATS_MS) {
+            LOG_INF("ui: %u wakeups, %u ms busy, %u touches, latency avg %u us max %u us",
+                    wakeups, k_cyc_to_ms_floor32(busy_cycles), touches,
+                    touches ? (uint32_t)(touch_us_sum / touches) : 0, touch_us_max);
+            wakeups = busy_cycles = touches = touch_us_max = 0;
+            touch_us_sum = 0;
+            stats_at = k_uptime_get();
+        }
+
+        events[0].state = K_POLL_STATE_NOT_READY;
+        events[1].state = K_POLL_STATE_NOT_READY;
+        k_poll(events, ARRAY_SIZE(events), next == LV_NO_TIMER_READY ? K_FOREVER : K_MSEC(next));
     }
 }
 
+// Called by http_stream() for every reading the gateway pushes.
+static void on_reading(char *json, size_t len) {
+    struct sensor_data data;
+    int err = json_obj_parse(json, len,
+                             sensor_descr, ARRAY_SIZE(sensor_descr),
+                             &data);
+    if (err < 0) {
+        LOG_ERR("JSON parse failed: %d", err);
+        return;
+    }
+
+    // Send sensor data to UI thread via message queue
+    if (k_msgq_put(&sensor_msgq, &data, K_NO_WAIT) != 0) {
+        // Queue is full, purge and try again
+        k_msgq_purge(&sensor_msgq);
+        k_msgq_put(&sensor_msgq, &data, K_NO_WAIT);
+    }
+}
+
+// Follows the gateway's /stream, which sends the latest reading on connect
+// and then each new one as it commits; reconnects 5 s after it drops.
 static void wifi_thread() {
-    char response[1024];
     while (1) {
-        int rc = http_get("192.168.0.49", 3000, "/device/AB12", response);
+        int rc = http_stream("192.168.0.49", 3000, "/stream?uuids=" DISPLAY_UUID, on_reading);
         if (rc) {
-            LOG_ERR("HTTP GET failed: %d", rc);
-        } else {
-            struct sensor_data data;
-            int err = json_obj_parse(response, strlen(response),
-                                     sensor_descr, ARRAY_SIZE(sensor_descr),
-                                     &data);
-            if (err < 0) {
-                LOG_ERR("JSON parse failed: %d", err);
-            } else {
-                // LOG_ERR("Parsed data: pressure=%u humidity=%u temperature=%u r=%u g=%u b=%u tvoc=%u accel_x=%d accel_y=%d accel_z=%d",
-                //         data.pressure, data.humidity, data.temperature,
-                //         data.r, data.g, data.b, data.tvoc,
-                //         data.accel_x, data.accel_y, data.accel_z);
-                
-                // Send sensor data to UI thread via message queue
-                if (k_msgq_put(&sensor_msgq, &data, K_NO_WAIT) != 0) {
-                    // Queue is full, purge and try again
-                    k_msgq_purge(&sensor_msgq);
-                    k_msgq_put(&sensor_msgq, &data, K_NO_WAIT);
-                }
-            }
+            LOG_ERR("HTTP stream failed: %d", rc);
         }
         k_msleep(5000);
     }
@@ -120,12 +120,15 @@ int wifi_disconnect(void)
     return net_mgmt(NET_REQUEST_WIFI_DISCONNECT, iface, NULL, 0);
 }
 
-int http_get(const char *ip, uint16_t port, const char *path, char* response)
+/**
+ * @brief Open a TCP connection to ip:port.
+ *
+ * @return The socket, or a negative error code.
+ */
+static int http_connect(const char *ip, uint16_t port)
 {
     int sock, ret;
     struct sockaddr_in addr;
-    char request[256];
-    char recv_buf[512];
 
     sock = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (sock < 0) {
@@ -150,6 +153,20 @@ int http_get(const char *ip, uint16_t port, const char *path, char* response)
         return ret;
     }
 
+    return sock;
+}
+
+int http_get(const char *ip, uint16_t port, const char *path, char* response)
+{
+    int sock, ret;
+    char request[256];
+    char recv_buf[512];
+
+    sock = http_connect(ip, port);
+    if (sock < 0) {
+        return sock;
+    }
+
     snprintf(request, sizeof(request),
              "GET %s HTTP/1.1\r\n"
              "Host: %s:%u\r\n"
@@ -184,4 +201,86 @@ int http_get(const char *ip, uint16_t port, const char *path, char* response)
     zsock_close(sock);
 
     return (ret < 0) ? ret : 0;
-}
\ No newline at end of file
+}
+
+int http_stream(const char *ip, uint16_t port, const char *path,
+                void (*on_data)(char *data, size_t len))
+{
+    int sock, ret;
+    char request[256];
+    char recv_buf[256];
+    char line[1024];
+    size_t len = 0;
+    bool in_body = false;
+    bool discard = false;
+    bool failed = false;
+    /* The gateway sends a heartbeat every 15 s; silence for longer than
+     * this means the connection is gone. */
+    struct timeval timeout = { .tv_sec = 45 };
+
+    sock = http_connect(ip, port);
+    if (sock < 0) {
+        return sock;
+    }
+    zsock_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    /* HTTP/1.0 so the body is not chunked. */
+    snprintf(request, sizeof(request),
+             "GET %s HTTP/1.0\r\n"
+             "Host: %s:%u\r\n"
+             "Accept: text/event-stream\r\n"
+             "\r\n", path, ip, port);
+    ret = zsock_send(sock, request, strlen(request), 0);
+    if (ret < 0) {
+        LOG_ERR("Failed to send HTTP request (%d)", ret);
+        zsock_close(sock);
+        return ret;
+    }
+
+    /* Split the response into lines. The headers end at the first empty
+     * line; after that, every "data: " line is one reading. Lines longer
+     * than the buffer are dropped. */
+    while ((ret = zsock_recv(sock, recv_buf, sizeof(recv_buf), 0)) > 0) {
+        for (int i = 0; i < ret && !failed; i++) {
+            char c = recv_buf[i];
+
+            if (c == '\r') {
+                continue;
+            }
+            if (c != '\n') {
+                if (len < sizeof(line) - 1) {
+                    line[len++] = c;
+                } else {
+                    discard = true;
+                }
+                continue;
+            }
+
+            line[len] = '\0';
+            if (!in_body) {
+                if (len == 0) {
+                    in_body = true;
+                } else if (strncmp(line, "HTTP/", 5) == 0 && strstr(line, " 200 ") == NULL) {
+                    LOG_ERR("Stream refused: %s", line);
+                    failed = true;
+                }
+            } else if (!discard && strncmp(line, "data: ", 6) == 0) {
+                on_data(line + 6, len - 6);
+            }
+            len = 0;
+            discard = false;
+        }
+        if (failed) {
+            ret = -EIO;
+            break;
+        }
+    }
+
+    if (ret < 0) {
+        LOG_ERR("HTTP stream ended (%d)", ret);
+    }
+
+    zsock_close(sock);
+
+    return (ret < 0) ? ret : 0;
+}
@@ -41,6 +41,19 @@ int wifi_disconnect(void);
  */
 int http_get(const char *ip, uint16_t port, const char *path, char* response);
 
+/**
+ * @brief Follow a server-sent event stream, calling on_data with the payload
+ *        of every "data:" line until the connection closes.
+ *
+ * @param ip      Null-terminated IPv4 address string.
+ * @param port    Port number in host byte order.
+ * @param path    Null-terminated HTTP path (must start with '/').
+ * @param on_data Called with each payload, null-terminated, and its length.
+ * @return        0 when the server closed the stream, negative error code on failure.
+ */
+int http_stream(const char *ip, uint16_t port, const char *path,
+                void (*on_data)(char *data, size_t len));
+
 // Structure to hold parsed sensor data
 struct sensor_data {
     char *uuid;